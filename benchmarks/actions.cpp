@@ -0,0 +1,110 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "parser.h"
+
+// Semantic Action Benchmark
+//
+// Compares Action, which stores closures in place, with the
+// std::function<void()> that parsers used to store actions in.  Both call
+// a closure through one indirect call, so calls cost about the same, while
+// copies of an Action neither allocate nor free.
+
+static const size_t N = 10000000; // action calls
+static const size_t M = 1000000;  // action copies
+
+// tokenizer with the tokens of 1+2*3-4+... to parse
+class CalcTokenizer : public Tokenizer
+{
+  public:
+    explicit CalcTokenizer(size_t n)
+    {
+      const char *ops = "+*-/";
+      for (size_t k = 0; k < n; ++k)
+      {
+        emplace_back(2, "7", 1, 1, 2 * k);
+        if (k + 1 < n)
+          emplace_back(ops[k % 4], ops + k % 4, 1, 1, 2 * k + 1);
+      }
+    }
+};
+
+template<typename F>
+static double run(F fun)
+{
+  auto start = std::chrono::steady_clock::now();
+  fun();
+  std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+  return t.count();
+}
+
+static void report(const char *what, double t, size_t n)
+{
+  std::printf("%-40s %8.3f s %8.2f ns/op\n", what, t, 1e9 * t / n);
+}
+
+// time calls of the closures of a calc-style grammar stored as type F
+template<typename F>
+static double calls(int& a, int& b)
+{
+  std::vector<F> acts;
+  acts.push_back([&]{ a += b; });
+  acts.push_back([&]{ a -= b; });
+  acts.push_back([&]{ a *= b; });
+  acts.push_back([&]{ if (b != 0) a /= b; });
+  return run([&]{
+    for (size_t k = 0; k < N; ++k)
+    {
+      b = static_cast<int>(k & 7);
+      acts[k & 3]();
+    }
+  });
+}
+
+// time copies of a closure that captures more than a few variables, as
+// grammar construction copies an action into each clone of its node
+template<typename F>
+static double copies(int& a, int& b, int& c, int& d)
+{
+  F act = [&]{ a = b + c + d; };
+  std::vector<F> acts(64);
+  return run([&]{
+    for (size_t k = 0; k < M; ++k)
+      acts[k & 63] = act;
+  });
+}
+
+int main()
+{
+  int a = 0, b = 0, c = 0, d = 0;
+
+  std::cout << "action calls" << std::endl;
+  report("std::function<void()>", calls< std::function<void()> >(a, b), N);
+  report("Action", calls<Action>(a, b), N);
+
+  std::cout << "action copies" << std::endl;
+  report("std::function<void()>", copies< std::function<void()> >(a, b, c, d), M);
+  report("Action", copies<Action>(a, b, c, d), M);
+
+  // parse with the actions of the calc example
+  Parser<> plus('+'), minus('-'), times('*'), divides('/'), num(2);
+  Parser<int> expr, term;
+  expr>>a = term>>a & *( plus & term>>b & [&]{ a += b; }
+      | minus & term>>b & [&]{ a -= b; } );
+  term>>a = num>>a & *( times & num>>b & [&]{ a *= b; }
+      | divides & num>>b & [&]{ a /= b; } );
+
+  CalcTokenizer tokens(100000);
+  size_t ok = 0;
+  double t = run([&]{
+    for (size_t k = 0; k < 10; ++k)
+      ok += expr.parse(&tokens);
+  });
+  std::cout << "parse" << std::endl;
+  report("calc expression of 100000 numbers", t / 10, 100000);
+
+  std::cout << "(result " << a + b + c + d << ", " << ok << " parses)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,603 @@
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <set>
+#include <sstream>
+#include <string>
+#include <map>
+#include <memory>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "grammar.h"
+#include "parser.h"
+#include "parsetree.h"
+#include "tokenstream.h"
+
+// Example Grammar Benchmark
+//
+// Parses large synthetic inputs with the grammars of the examples calc,
+// calc_advanced, calc_flow, calc_complex_num, binary, counting, dcg and
+// parser_printer, with and without building a ParseTree.  A row is one
+// grammar parsing its input, one parse per line, number, run or sentence,
+// as the example would parse them one after the other.
+//
+// Reports the tokens and parses per second of the fastest of R runs, the
+// allocations per parse counted by the global operator new, and the peak
+// RSS of the process that ran the row, as each row runs in a child process.
+//
+// Then measures the startup of grammars: the time to build and to destroy
+// the calc grammar and a synthetic grammar of G productions, and the
+// allocations per build, with nodes allocated by operator new and with
+// nodes allocated from a Grammar.
+
+static const size_t N = 1000000; // tokens per input, about
+static const size_t R = 3;       // runs per row
+static const size_t G = 2000;    // productions of the synthetic grammar
+static const size_t K = 200;     // builds per startup row, a tenth for the synthetic grammar
+
+static size_t allocs = 0; // calls of operator new
+
+// GCC takes the replacement operators below for a mismatched new and free
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size)
+{
+  ++allocs;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+// tokenizer of synthetic text: numbers, identifiers, keywords and characters
+// as scanned by the examples' flex specifications, space-separated words, or
+// characters only
+class TextTokenizer : public Tokenizer
+{
+  public:
+    enum Scan { CALC, WORDS, CHARS };
+
+    using Tokenizer::size;
+
+    TextTokenizer(const std::string& text, Scan scan = CALC)
+      :
+        text_(text)
+    {
+      const char *b = text_.data(), *end = b + text_.size();
+      for (const char *s = b; s < end; )
+      {
+        const char *t = s + 1;
+        int code = *s;
+        if (*s == ' ')
+        {
+          ++s;
+          continue;
+        }
+        if (scan == WORDS)
+        {
+          while (t < end && *t != ' ')
+            ++t;
+          code = -1;
+        }
+        else if (scan == CALC && *s >= '0' && *s <= '9')
+        {
+          while (t < end && ((*t >= '0' && *t <= '9') || *t == '.'))
+            ++t;
+          if (t < end && *t == 'j')
+            ++t;
+          code = 2;
+        }
+        else if (scan == CALC && *s >= 'a' && *s <= 'z' && s + 1 < end && ((s[1] >= 'a' && s[1] <= 'z') || (s[1] >= '0' && s[1] <= '9')))
+        {
+          while (t < end && ((*t >= 'a' && *t <= 'z') || (*t >= '0' && *t <= '9')))
+            ++t;
+          std::string id(s, t - s);
+          code = id == "log" ? 3 : id == "sin" ? 4 : id == "cos" ? 5 : id == "tan" ? 6 : 1;
+        }
+        emplace_view(code, s, t - s, 1, s - b);
+        s = t;
+      }
+    }
+
+  protected:
+    std::string text_;
+};
+
+// deterministic pseudo-random numbers
+static size_t next()
+{
+  static size_t seed = 1;
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (seed >> 33) & 0x7fffffff;
+}
+
+// append a random expression of numbers 1 to 99, and of ids when given, to text
+static void expression(std::string& text, int depth, const char *ids = NULL, bool imag = false)
+{
+  const char *ops = "+-*/";
+  size_t n = 1 + next() % 4;
+  for (size_t k = 0; k < n; ++k)
+  {
+    char op = ops[next() % 4];
+    if (k > 0)
+    {
+      text += ' ';
+      text += op;
+      text += ' ';
+    }
+    // divisors are numbers, so integer division never divides by zero
+    if (depth > 0 && next() % 4 == 0 && !(k > 0 && op == '/'))
+    {
+      text += "(";
+      expression(text, depth - 1, ids, imag);
+      text += ")";
+    }
+    else if (ids != NULL && next() % 3 == 0 && !(k > 0 && op == '/'))
+    {
+      text += ids[next() % strlen(ids)];
+      text += "1";
+    }
+    else
+    {
+      text += std::to_string(1 + next() % 99);
+      if (imag && next() % 2)
+        text += "j";
+    }
+  }
+}
+
+// parse the tokens with start, one parse after the other, skipping the
+// tokens from the end of a parse up to a sep token and the sep token itself
+template<typename P>
+static void bench(const char *name, P& start, TextTokenizer& tokens, bool build, int sep = 0)
+{
+  double best = 0;
+  size_t parses = 0;
+  size_t count = allocs;
+  for (size_t r = 0; r < R; ++r)
+  {
+    ParseTree tree;
+    parses = 0;
+    auto begin = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (pos < tokens.size())
+    {
+      if (!start.parse(&tokens, &pos, build ? &tree : NULL))
+      {
+        std::printf("%s: parse failed at token %zu\n", name, pos);
+        std::exit(EXIT_FAILURE);
+      }
+      ++parses;
+      if (sep != 0)
+      {
+        while (pos < tokens.size() && tokens.code(pos) != sep)
+          ++pos;
+        if (pos < tokens.size())
+          ++pos;
+      }
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - begin;
+    if (r == 0 || t.count() < best)
+      best = t.count();
+  }
+  count = allocs - count;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  std::printf("%-18s %-5s %10.3f %10.3f %12.2f %10.1f\n",
+      name,
+      build ? "tree" : "",
+      tokens.size() / best / 1e6,
+      parses / best / 1e6,
+      static_cast<double>(count) / (R * parses),
+      usage.ru_maxrss / 1024.0);
+}
+
+static void calc(bool build)
+{
+  std::string text;
+  while (text.size() < 2 * N)
+  {
+    expression(text, 3);
+    text += "\n";
+  }
+  TextTokenizer tokens(text);
+
+  Parser<> plus('+'), minus('-'), times('*'), divides('/'), num(2);
+  Parser<int> line, expr, fact, term;
+  int a(0), b(0);
+
+  line>>a = expr>>a & Token('\n')
+          | !Token('q')
+          | !Token('Q');
+  expr>>a = term>>a & *( plus & term>>b & [&]{ a += b; }
+      | minus & term>>b & [&]{ a -= b; } );
+  term>>a = fact>>a & *( times & fact>>b & [&]{ a *= b; }
+      | divides & fact>>b & [&]{ a /= b; } );
+  fact>>a = Token('(') & expr>>a & Token(')') | num>>a;
+
+  bench("calc", line, tokens, build);
+}
+
+TokenStream<std::map<std::string,float>>& operator>>(TokenStream<std::map<std::string,float>>& in, float& out)
+{
+  auto v = in.get_in()->find(in.get_text());
+  if (v == in.get_in()->end())
+    throw extraction_error("Failed to find variable in symbol table");
+  out = v->second;
+  return in;
+}
+
+static void calc_advanced(bool build)
+{
+  // each line assigns x1 and y1, then evaluates an expression of them
+  std::string text;
+  while (text.size() < 2 * N)
+  {
+    text += "x1 = ";
+    expression(text, 2);
+    text += "; y1 = ";
+    expression(text, 2, "x");
+    text += "; ";
+    const char *fun[] = { "log", "sin", "cos", "tan" };
+    text += fun[next() % 4];
+    text += "(";
+    expression(text, 2, "xy");
+    text += ") ^ 2 - ";
+    expression(text, 2, "xy");
+    text += ";\n";
+  }
+  TextTokenizer tokens(text);
+
+  std::map<std::string,float> sym;
+  Parser<float> line, input, expr, fact, term,
+    num(2), log(3), sin(4), cos(5), tan(6);
+  Parser<std::string,std::string> new_id(1);
+  Parser<std::map<std::string,float>,float> id(1);
+  float a(0), b(0);
+  std::string c;
+
+  line>>a = input>>a & '\n'
+          | !Token('q')
+          | !Token('Q');
+  input>>a = *(new_id>>c & '=' & expr>>a & ';' & [&]{ sym[c] = a; })
+      & expr>>a & ';';
+  expr>>a = term>>a & *( '+' & term>>b & [&]{ a += b; }
+      | '-' & term>>b & [&]{ a -= b; } );
+  term>>a = fact>>a & *( '*' & fact>>b & [&]{ a *= b; }
+      | '/' & fact>>b & [&]{ a /= b; } );
+  fact>>a =
+    (
+      '(' & expr>>a & ')'
+      | log & '(' & expr>>a & ')' & [&]{ a = std::log(a); }
+      | sin & '(' & expr>>a & ')' & [&]{ a = std::sin(a); }
+      | cos & '(' & expr>>a & ')' & [&]{ a = std::cos(a); }
+      | tan & '(' & expr>>a & ')' & [&]{ a = std::tan(a); }
+      | id(sym)>>a
+      | num>>a
+    ) & -( '^' & fact>>b & [&]{ a = std::pow(a,b); });
+
+  bench("calc_advanced", line, tokens, build);
+}
+
+static void calc_flow(bool build)
+{
+  std::string text;
+  while (text.size() < 2 * N)
+  {
+    expression(text, 3);
+    text += "\n";
+  }
+  TextTokenizer tokens(text);
+
+  Parser<int> line, expr, fact, term, term_tail, fact_tail, num(2);
+  int a(0), b(0), c(0), d(0);
+
+  line>>a = expr>>a & '\n'
+          | !Token('q')
+          | !Token('Q');
+  expr>>a = term>>a & term_tail(a)>>a;
+  term_tail(b)>>b = -('+' & term>>c & [&]{ d = b + c; } & term_tail(d)>>b
+      | '-' & term>>c & [&]{ d = b - c; } & term_tail(d)>>b);
+  term>>a = fact>>a & fact_tail(a)>>a;
+  fact_tail(b)>>b = -('*' & fact>>c & [&]{ d = b * c; } & fact_tail(d)>>b
+      | '/' & fact>>c & [&]{ d = b / c; } & fact_tail(d)>>b);
+  fact>>a = num>>a | '(' & expr>>a & ')';
+
+  bench("calc_flow", line, tokens, build);
+}
+
+typedef std::complex<double> ComplexNum;
+
+TokenStream<ComplexNum>& operator>>(TokenStream<ComplexNum>& is, ComplexNum& out)
+{
+  std::string tok = is.get_text();
+  bool imag = tok.back() == 'j';
+  if (imag)
+    tok.pop_back();
+  std::stringstream tok_stream(tok);
+  double x = 0;
+  tok_stream >> x;
+  out = imag ? ComplexNum(0, x) : ComplexNum(x, 0);
+  return is;
+}
+
+static void calc_complex_num(bool build)
+{
+  std::string text;
+  while (text.size() < 2 * N)
+  {
+    expression(text, 3, NULL, true);
+    text += "\n";
+  }
+  TextTokenizer tokens(text);
+
+  Parser<ComplexNum> line, expr, fact, term, num(2);
+  ComplexNum a, b;
+
+  line>>a = expr>>a & '\n'
+          | !Token('q')
+          | !Token('Q');
+  expr>>a = term>>a & *( '+' & term>>b & [&]{ a += b; }
+      | '-' & term>>b & [&]{ a -= b; });
+  term>>a = fact>>a & *( '*' & fact>>b & [&]{ a *= b; }
+      | '/' & fact>>b & [&]{ a /= b; } );
+  fact>>a = '(' & expr>>a & ')' | num>>a;
+
+  bench("calc_complex_num", line, tokens, build);
+}
+
+static void binary(bool build)
+{
+  // comma-separated numbers of 1 to 32 bits
+  std::string text;
+  while (text.size() < N)
+  {
+    for (size_t k = 1 + next() % 32; k > 0; --k)
+      text += next() % 2 ? '1' : '0';
+    text += ',';
+  }
+  TextTokenizer tokens(text, TextTokenizer::CHARS);
+
+  Parser<int> REC_NUM, IT_NUM, BIT, GETBIT;
+  int x = 0, y = 0, b = 0, z = 0;
+
+  REC_NUM(x)>>z = GETBIT(x)>>y & REC_NUM(y)>>z
+    | GETBIT(x)>>z;
+  IT_NUM>>z = [&]{ z = 0; } & +( BIT>>b & [&]{ z = 2 * z + b; } );
+  GETBIT(x)>>z = BIT>>b & [&]{ z = 2 * x + b; };
+  BIT>>b = Token('0') & [&]{ b = 0; }
+    | Token('1') & [&]{ b = 1; };
+
+  bench("binary REC_NUM", REC_NUM, tokens, build, ',');
+  bench("binary IT_NUM", IT_NUM, tokens, build, ',');
+}
+
+static void counting(bool build)
+{
+  // comma-separated runs of 1 to 64 a's
+  std::string text;
+  while (text.size() < N)
+  {
+    text.append(1 + next() % 64, 'a');
+    text += ',';
+  }
+  TextTokenizer tokens(text, TextTokenizer::CHARS);
+
+  Parser<int> A;
+  int x = 0;
+
+  A>>x = Token('a') & A>>x & [&]{ x++; } | Token('a') & [&]{ x = 1; };
+
+  bench("counting", A, tokens, build, ',');
+}
+
+TokenStream<std::set<std::string>>& operator>>(TokenStream<std::set<std::string>>& in, int& out)
+{
+  const std::string& text = in.get_text();
+  if (text == "I" || text == "me")
+    out = 1;
+  else if (text == "We" || text == "us")
+    out = 2;
+  else if (text == "You" || text == "you")
+    out = 4;
+  else
+    out = 0;
+  if (in.get_in()->find(text) == in.get_in()->end())
+    throw extraction_error("Invalid word");
+  return in;
+}
+
+static void dcg(bool build)
+{
+  std::set<std::string> mixed_subject_words = { "I", "We", "You", "They" };
+  std::set<std::string> third_sing_subj_words = { "He", "She", "It" };
+  std::set<std::string> object_words = { "me", "us", "you", "him", "her", "it", "them" };
+  std::set<std::string> verb_words1 = { "like", "hate", "love" };
+  std::set<std::string> verb_words2 = { "likes", "hates", "loves" };
+
+  // sentences with subjects and objects that are not the same person
+  const char *subjects[] = { "I", "We", "You", "They", "He", "She", "It" };
+  const char *verbs[] = { "like", "hate", "love" };
+  const char *objects[] = { "him", "her", "it", "them" };
+  std::string text;
+  while (text.size() < 4 * N)
+  {
+    size_t s = next() % 7;
+    text.append(subjects[s]).append(" ").append(verbs[next() % 3]).append(s >= 4 ? "s " : " ").append(objects[next() % 4]).append(" ");
+  }
+  TextTokenizer tokens(text, TextTokenizer::WORDS);
+
+  int subject_flag = 0, object_flag = 0, dummy = 0;
+  Parser<> sentence;
+  Parser<std::set<std::string>,int> word(-1);
+
+  sentence = (
+      word(mixed_subject_words)>>subject_flag & word(verb_words1)>>dummy
+    | word(third_sing_subj_words)>>subject_flag & word(verb_words2)>>dummy
+    ) & word(object_words)>>object_flag
+      & [&]{ if (subject_flag & object_flag) { throw parsing_error(""); } };
+
+  bench("dcg", sentence, tokens, build);
+}
+
+static void parser_printer(bool build)
+{
+  // comma-separated a's followed by b or by cd's
+  std::string text;
+  while (text.size() < N)
+  {
+    text.append(next() % 8, 'a');
+    if (next() % 2)
+      text += 'b';
+    else
+      for (size_t k = 1 + next() % 4; k > 0; --k)
+        text += "cd";
+    text += ',';
+  }
+  TextTokenizer tokens(text, TextTokenizer::CHARS);
+
+  Parser<> input, more, a('a'), b('b'), c('c'), d('d');
+
+  input = *(a) & ~(b | +(more));
+  more = c & d;
+
+  bench("parser_printer", input, tokens, build, ',');
+}
+
+// the calc grammar as a whole
+struct Calc
+{
+  Calc()
+    :
+      plus('+'), minus('-'), times('*'), divides('/'), num(2),
+      a(0), b(0)
+  {
+    line>>a = expr>>a & Token('\n')
+            | !Token('q')
+            | !Token('Q');
+    expr>>a = term>>a & *( plus & term>>b & [&]{ a += b; }
+        | minus & term>>b & [&]{ a -= b; } );
+    term>>a = fact>>a & *( times & fact>>b & [&]{ a *= b; }
+        | divides & fact>>b & [&]{ a /= b; } );
+    fact>>a = Token('(') & expr>>a & Token(')') | num>>a;
+  }
+  Parser<> plus, minus, times, divides, num;
+  Parser<int> line, expr, fact, term;
+  int a, b;
+};
+
+// synthetic grammar of G productions of tokens, characters, repeats,
+// options, lookaheads, actions and nonterminals
+struct Large
+{
+  Large()
+    :
+      rules(new Parser<int>[G]),
+      a(0), b(0)
+  {
+    for (size_t k = 0; k < G; ++k)
+    {
+      Parser<int>& next = rules[(k + 1) % G];
+      Parser<int>& other = rules[(k * 7 + 3) % G];
+      int c = 'a' + k % 26;
+      rules[k]>>a = Token(c) & next>>a & *( '+' & other>>b & [&]{ a += b; }
+          | '-' & other>>b & [&]{ a -= b; } )
+        | Token(c + 1) & -( ',' & Token(2) ) & ~Token(';') & [&]{ a = 0; }
+        | '(' & other>>a & ')';
+    }
+  }
+  std::unique_ptr<Parser<int>[]> rules;
+  int a, b;
+};
+
+// build n instances of a grammar, then destroy them, with nodes allocated
+// by operator new or from a Grammar of each instance
+template<typename T>
+static void startup(const char *name, bool arena, size_t n)
+{
+  double build = 0, teardown = 0;
+  size_t count = 0, size = 0;
+  for (size_t r = 0; r < R; ++r)
+  {
+    std::vector<std::unique_ptr<Grammar>> grammars(n);
+    std::vector<T*> instances(n);
+    size_t before = allocs;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < n; ++k)
+    {
+      if (arena)
+      {
+        grammars[k].reset(new Grammar);
+        Grammar::Build use(*grammars[k]);
+        instances[k] = new T;
+      }
+      else
+      {
+        instances[k] = new T;
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+    count = allocs - before;
+    size = arena ? grammars[0]->size() : 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+      delete instances[k];
+      grammars[k].reset();
+    }
+    std::chrono::duration<double> t = end - begin, u = std::chrono::steady_clock::now() - end;
+    if (r == 0 || t.count() < build)
+      build = t.count();
+    if (r == 0 || u.count() < teardown)
+      teardown = u.count();
+  }
+  std::printf("%-18s %-5s %10.1f %10.1f %12.1f %10.1f\n",
+      name,
+      arena ? "arena" : "new",
+      build / n * 1e6,
+      teardown / n * 1e6,
+      static_cast<double>(count) / n,
+      size / 1024.0);
+}
+
+int main()
+{
+  void (*grammars[])(bool) = { calc, calc_advanced, calc_flow, calc_complex_num, binary, counting, dcg, parser_printer };
+  std::printf("%-18s %-5s %10s %10s %12s %10s\n", "grammar", "", "Mtokens/s", "Mparses/s", "allocs/parse", "peak MB");
+  for (auto grammar : grammars)
+  {
+    for (int build = 0; build < 2; ++build)
+    {
+      // run the row in a child process of its own to measure its peak RSS
+      std::fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0)
+      {
+        grammar(build != 0);
+        std::fflush(stdout);
+        _exit(EXIT_SUCCESS);
+      }
+      int status = 0;
+      if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    }
+  }
+  std::printf("\n%-18s %-5s %10s %10s %12s %10s\n", "grammar", "nodes", "build us", "destroy us", "allocs/build", "arena KB");
+  for (int arena = 0; arena < 2; ++arena)
+  {
+    startup<Calc>("calc", arena != 0, K);
+    startup<Large>("synthetic", arena != 0, K / 10);
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parser.h"
+#include "records.h"
+
+// Record-Parallel Parsing Benchmark
+//
+// Parses a buffer of calc expressions, one per line, with Records on 1 to
+// the number of cores threads, and checks that the results are the same as
+// those of a sequential parse.
+
+static const size_t N = 1000000; // lines
+
+// tokenizer of a line of digits and operators, reused for each line
+class LineTokenizer : public Tokenizer
+{
+  public:
+    void scan(const char *begin, const char *end)
+    {
+      clear();
+      for (const char *s = begin; s < end; )
+      {
+        if (*s >= '0' && *s <= '9')
+        {
+          const char *t = s;
+          while (t < end && *t >= '0' && *t <= '9')
+            ++t;
+          emplace_back(2, s, t - s, 1, s - begin);
+          s = t;
+        }
+        else
+        {
+          if (*s != ' ')
+            emplace_back(*s, s, 1, 1, s - begin);
+          ++s;
+        }
+      }
+    }
+};
+
+// parses a line with its own grammar and flow variables
+class Line
+{
+  public:
+    typedef int Result;
+
+    Line()
+      :
+        plus('+'),
+        minus('-'),
+        times('*'),
+        divides('/'),
+        num(2),
+        a(0),
+        b(0)
+    {
+      line>>a = expr>>a & Token('\n');
+      expr>>a = term>>a & *( plus & term>>b & [&]{ a += b; }
+          | minus & term>>b & [&]{ a -= b; } );
+      term>>a = fact>>a & *( times & fact>>b & [&]{ a *= b; }
+          | divides & fact>>b & [&]{ if (b != 0) a /= b; } );
+      fact>>a = Token('(') & expr>>a & Token(')') | num>>a;
+    }
+    Result operator()(const char *begin, const char *end)
+    {
+      tokens.scan(begin, end);
+      if (!line.parse(&tokens))
+        return -1;
+      return a;
+    }
+
+  protected:
+    LineTokenizer tokens;
+    Parser<>      plus, minus, times, divides, num;
+    Parser<int>   line, expr, term, fact;
+    int           a, b;
+};
+
+template<typename F>
+static double run(F fun)
+{
+  auto start = std::chrono::steady_clock::now();
+  fun();
+  std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+  return t.count();
+}
+
+int main()
+{
+  std::string input;
+  for (size_t k = 0; k < N; ++k)
+  {
+    input += std::to_string(k % 97) + " + " + std::to_string(k % 13) + " * (" + std::to_string(k % 7) + " - 2)";
+    input += k % 3 ? " / 3\n" : "\n";
+  }
+
+  std::vector<int> expected;
+  Line line;
+  double t1 = run([&]{
+    const char *b = input.data(), *end = b + input.size();
+    while (b < end)
+    {
+      const char *e = b;
+      while (*e++ != '\n')
+        continue;
+      expected.push_back(line(b, e));
+      b = e;
+    }
+  });
+  std::printf("%-40s %8.3f s %8.2f MB/s\n", "sequential", t1, input.size() / t1 / 1e6);
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t n = 1; n <= cores; n *= 2)
+  {
+    Records<Line> records(n);
+    std::vector<int> results;
+    double t = run([&]{ results = records.parse(input.data(), input.size()); });
+    char what[40];
+    std::snprintf(what, sizeof(what), "Records with %zu threads", n);
+    std::printf("%-40s %8.3f s %8.2f MB/s %5.2fx %s\n", what, t, input.size() / t / 1e6, t1 / t, results == expected ? "" : "WRONG RESULTS");
+    if (n < cores && 2 * n > cores)
+      n = cores / 2;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "dfatokenizer.h"
+#include "flextokenizer.h"
+
+// Tokenizer Benchmark
+//
+// Scans a buffer of calc expressions with the scanner that Flex generates
+// from examples/calc/calc.l and with a DFATokenizer with the same rules, and
+// checks that both produce the same tokens.
+
+static const size_t N = 2000000; // lines
+static const int NUM = 2;        // token code of calc.l
+
+// scan all tokens, committing them as they are consumed, returns the number of tokens and a checksum of them
+template<typename T>
+static size_t scan(T& tokens, size_t& sum)
+{
+  size_t pos = 0;
+  sum = 0;
+  while (tokens.has_pos(pos))
+  {
+    Tokenizer::Token t = tokens.at(pos);
+    sum = 31 * sum + t.code + t.text.size() + t.lineno + t.columno;
+    if (++pos % 4096 == 0)
+      tokens.commit(pos);
+  }
+  return pos;
+}
+
+template<typename F>
+static double run(F fun)
+{
+  auto start = std::chrono::steady_clock::now();
+  fun();
+  std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+  return t.count();
+}
+
+int main()
+{
+  std::string input;
+  for (size_t k = 0; k < N; ++k)
+  {
+    input += std::to_string(k % 997) + " + " + std::to_string(k % 13) + " * (" + std::to_string(k % 7) + " - 2)";
+    input += k % 3 ? "  /  3\n" : "\n";
+  }
+
+  size_t n1, sum1;
+  double t1 = run([&]{
+    FlexTokenizer tokens(input);
+    n1 = scan(tokens, sum1);
+  });
+  std::printf("%-40s %8.3f s %8.2f Mtokens/s\n", "FlexTokenizer", t1, n1 / t1 / 1e6);
+
+  Lexer lexer({
+    { "[-+*/=()\nqQ]", Lexer::SELF },
+    { "[0-9]*([0-9]|\\.[0-9]|[0-9]\\.)[0-9]*", NUM },
+    { ".", Lexer::SKIP },
+  });
+  size_t n2, sum2;
+  double t2 = run([&]{
+    DFATokenizer tokens(&lexer, input.data(), input.size());
+    n2 = scan(tokens, sum2);
+  });
+  std::printf("%-40s %8.3f s %8.2f Mtokens/s %5.2fx %s\n", "DFATokenizer", t2, n2 / t2 / 1e6, t1 / t2, n1 == n2 && sum1 == sum2 ? "" : "WRONG TOKENS");
+
+  double t3 = run([&]{
+    Lexer lexer({
+      { "[-+*/=()\nqQ]", Lexer::SELF },
+      { "[0-9]*([0-9]|\\.[0-9]|[0-9]\\.)[0-9]*", NUM },
+      { ".", Lexer::SKIP },
+    });
+  });
+  std::printf("%-40s %8.3f ms, %zu states, %zu byte classes\n", "Lexer construction", 1e3 * t3, lexer.states(), lexer.classes());
+  return 0;
+}
@@ -0,0 +1,329 @@
+#include <algorithm> // std::min()
+#include <cstdio>
+#include <cstdlib>
+#include <memory>    // std::unique_ptr
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parser.h"
+#include "analysis.h"
+#include "context.h"
+#include "dfatokenizer.h"
+#include "program.h"
+
+// Differential Test
+//
+// Builds random grammars of tokens, actions, sequences, alternations,
+// repeats, options, lookaheads and (left-recursive) nonterminals, and
+// parses random inputs with them in several ways that must agree:
+//
+//   the grammar as built, by Parser::parse() and by a Program
+//   the grammar indexed by Analysis::index(), by Parser::parse() and by a Program
+//   the grammar frozen, by Parser::parse() with a Context
+//
+// Each parse logs the actions it runs, which must be the same, as must the
+// success and the end position of the parses.  A memoized copy of the
+// grammar also reparses each input after an edit, which must succeed and
+// end where a parse of the edited input does.
+//
+// Threads also parse with the frozen grammar of calc, which computes its
+// values in flow variables, and check the values.
+//
+// Exits with EXIT_FAILURE after printing the first mismatches, if any.
+
+static const size_t GRAMMARS = 2000; // random grammars
+static const size_t INPUTS = 60;     // random inputs per grammar
+static const size_t DEFS = 4;        // nonterminals per grammar
+
+// tokenizer of the characters of a string
+class CharTokenizer : public Tokenizer
+{
+  public:
+    explicit CharTokenizer(const std::string& text)
+      :
+        text_(text)
+    {
+      for (size_t k = 0; k < text_.size(); ++k)
+        emplace_back(text_[k], &text_[k], 1, 1, k);
+    }
+    // returns the tokens of an edit
+    static std::vector<Token> edit(const std::string& text)
+    {
+      std::vector<Token> tokens;
+      for (size_t k = 0; k < text.size(); ++k)
+        tokens.push_back(Token(text[k], Lexeme(&text[k], 1), 1, k));
+      return tokens;
+    }
+
+  protected:
+    std::string text_;
+};
+
+// a random grammar, the same for the same seed
+class RandomGrammar
+{
+  public:
+    explicit RandomGrammar(unsigned seed)
+      :
+        rng_(seed)
+    {
+      for (int k = 0; k < 3; ++k)
+        tok_.emplace_back(new Parser<>('a' + k));
+      for (size_t k = 0; k < DEFS; ++k)
+      {
+        E body = sequence(token(), expression(2));
+        if (rng_() % 4 == 0)
+          body = alternation(sequence(E(def_[k], false), expression(1)), body); // left-recursive
+        assign(def_[k], body);
+      }
+      E start = expression(3);
+      for (size_t n = rng_() % 3; n > 0; --n)
+        start = alternation(start, expression(3));
+      assign(start_, start);
+    }
+    // memoize the nonterminals
+    void memoize()
+    {
+      for (size_t k = 0; k < DEFS; ++k)
+        def_[k].memoize();
+    }
+    Parser<>& start()
+    {
+      return start_;
+    }
+    std::string log; // actions run by the last parse
+
+  protected:
+
+    // a node of the grammar, and whether it is the temporary of an operator
+    struct E
+    {
+      E(const BaseParser& node)
+        :
+          node(const_cast<BaseParser*>(&node)),
+          temp(true)
+      { }
+      E(BaseParser& node, bool temp = false)
+        :
+          node(&node),
+          temp(temp)
+      { }
+      BaseParser *node;
+      bool        temp;
+    };
+
+    // apply the operators to temporaries as const, as the operators of a rule do
+    static const BaseParser& c(E e)
+    {
+      return *e.node;
+    }
+    static E sequence(E x, E y)
+    {
+      if (x.temp)
+        return y.temp ? E(c(x) & c(y)) : E(c(x) & *y.node);
+      return y.temp ? E(*x.node & c(y)) : E(*x.node & *y.node);
+    }
+    static E alternation(E x, E y)
+    {
+      if (x.temp)
+        return y.temp ? E(c(x) | c(y)) : E(c(x) | *y.node);
+      return y.temp ? E(*x.node | c(y)) : E(*x.node | *y.node);
+    }
+    static void assign(Parser<>& def, E e)
+    {
+      if (e.temp)
+        def = c(e);
+      else
+        def = *e.node;
+    }
+    E token()
+    {
+      return E(*tok_[rng_() % tok_.size()]);
+    }
+    E action()
+    {
+      char name = 'A' + rng_() % 26;
+      return E(1 * BaseParser([this, name]{ log += name; }));
+    }
+    E expression(int depth)
+    {
+      switch (depth > 0 ? rng_() % 10 : rng_() % 3)
+      {
+        case 0:
+        case 1:
+          return token();
+        case 2:
+          return E(def_[rng_() % DEFS]);
+        case 3:
+          return sequence(expression(depth - 1), action());
+        case 4:
+        case 5:
+          return sequence(expression(depth - 1), expression(depth - 1));
+        case 6:
+          return alternation(expression(depth - 1), expression(depth - 1));
+        case 7:
+        {
+          // a repeat consumes a token each time
+          E body = sequence(token(), expression(depth - 1));
+          return rng_() % 2 ? E(*c(body)) : E(+c(body));
+        }
+        case 8:
+        {
+          E body = expression(depth - 1);
+          return body.temp ? E(-c(body)) : E(-*body.node);
+        }
+        default:
+        {
+          // lookaheads may run actions after their first token
+          E body = sequence(expression(depth - 1), sequence(action(), expression(depth - 1)));
+          return rng_() % 2 ? E(~c(body)) : E(!c(body));
+        }
+      }
+    }
+
+    std::mt19937                            rng_;   // generator of the grammar
+    std::vector<std::unique_ptr<Parser<> > > tok_;  // terminals a, b and c
+    Parser<>                                def_[DEFS]; // nonterminals
+    Parser<>                                start_; // start of the grammar
+};
+
+// regression: an alternative that starts with a lookahead running actions after its first token
+static bool lookahead_actions()
+{
+  std::string log;
+  Parser<> s, k, a('a'), b('b'), c('c');
+  k = a & [&]{ log += "K"; };
+  s = ((!((a | c) & ~k & b)) & c)
+    | (a & [&]{ log += "J"; });
+  CharTokenizer tokens("aab");
+  size_t pos = 0;
+  s.parse(&tokens, &pos);
+  std::string plain = log;
+  Analysis(&s).index();
+  log.clear();
+  pos = 0;
+  s.parse(&tokens, &pos);
+  if (plain == "KJ" && log == plain)
+    return true;
+  std::printf("lookahead actions: logged %s and %s when indexed, expected KJ\n", plain.c_str(), log.c_str());
+  return false;
+}
+
+// threads that parse in turn with their own Context and Program share the frozen grammar of calc
+static bool frozen_flow()
+{
+  Parser<> plus('+'), minus('-'), times('*'), divides('/'), num(2);
+  Parser<int> line, expr, fact, term;
+  int a(0), b(0);
+  line>>a = expr>>a & Token('\n');
+  expr>>a = term>>a & *( (plus & term>>b & [&]{ a += b; })
+      | (minus & term>>b & [&]{ a -= b; }) );
+  term>>a = fact>>a & *( (times & fact>>b & [&]{ a *= b; })
+      | (divides & fact>>b & [&]{ a /= b; }) );
+  fact>>a = (Token('(') & expr>>a & Token(')')) | num>>a;
+  fact.memoize();
+  line.freeze();
+  Lexer lexer({
+    { "[-+*/()\n]", Lexer::SELF },
+    { "[0-9]+", 2 },
+    { ".", Lexer::SKIP },
+  });
+  std::mutex mutex; // flow variables a and b are shared by all parses
+  size_t wrong = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+    threads.emplace_back([&, t]{
+      Context ctx;
+      Program prog(&line);
+      for (int k = 0; k < 1000; ++k)
+      {
+        int x = 1000 * t + k;
+        std::string text = "(" + std::to_string(x) + " - 1) * (2 + 3) / 5 - ((1))\n";
+        DFATokenizer tokens(&lexer, text);
+        std::lock_guard<std::mutex> lock(mutex);
+        bool ok = k % 2 ? prog.parse(ctx, &tokens) : line.parse(ctx, &tokens);
+        if ((!ok || a != x - 2) && wrong++ < 10)
+          std::printf("frozen calc: %s gives %d, expected %d\n", text.c_str(), a, x - 2);
+      }
+    });
+  for (auto& t : threads)
+    t.join();
+  return wrong == 0;
+}
+
+// parse and return the success, end position and actions of the parse
+static std::string run(RandomGrammar& g, Program *prog, Context *ctx, Tokenizer *tokens)
+{
+  size_t pos = 0;
+  g.log.clear();
+  bool ok;
+  if (prog)
+    ok = prog->parse(tokens, &pos);
+  else if (ctx)
+    ok = g.start().parse(*ctx, tokens, &pos);
+  else
+    ok = g.start().parse(tokens, &pos);
+  return std::to_string(ok) + " " + (ok ? std::to_string(pos) : "-") + " " + g.log;
+}
+
+int main()
+{
+  size_t mismatches = lookahead_actions() ? 0 : 1;
+  if (!frozen_flow())
+    ++mismatches;
+  size_t parses = 0, oks = 0;
+  std::mt19937 rng(1);
+  for (unsigned seed = 1; seed <= GRAMMARS; ++seed)
+  {
+    RandomGrammar plain(seed), indexed(seed), frozen(seed), memoized(seed);
+    Analysis(&indexed.start()).index();
+    Analysis(&frozen.start()).index();
+    frozen.start().freeze();
+    memoized.memoize();
+    Program plain_prog(&plain.start()), indexed_prog(&indexed.start());
+    Context ctx;
+    for (size_t n = 0; n < INPUTS; ++n)
+    {
+      std::string text;
+      for (size_t k = rng() % 9; k > 0; --k)
+        text += 'a' + rng() % 3;
+      CharTokenizer tokens(text);
+      std::string expected = run(plain, NULL, NULL, &tokens);
+      std::string results[] = {
+        run(plain, &plain_prog, NULL, &tokens),
+        run(indexed, NULL, NULL, &tokens),
+        run(indexed, &indexed_prog, NULL, &tokens),
+        run(frozen, NULL, &ctx, &tokens),
+      };
+      const char *names[] = { "program", "indexed", "indexed program", "frozen" };
+      for (size_t k = 0; k < 4; ++k)
+        if (results[k] != expected && mismatches++ < 10)
+          std::printf("grammar %u input '%s': %s gives %s, expected %s\n", seed, text.c_str(), names[k], results[k].c_str(), expected.c_str());
+      ++parses;
+      if (expected[0] == '1')
+        ++oks;
+
+      // reparse after replacing up to two tokens by up to two tokens
+      size_t from = rng() % (text.size() + 1);
+      size_t to = std::min(text.size(), from + rng() % 3);
+      std::string insert;
+      for (size_t k = rng() % 3; k > 0; --k)
+        insert += 'a' + rng() % 3;
+      size_t pos = 0;
+      memoized.start().parse(&tokens, &pos);
+      pos = 0;
+      bool ok = memoized.start().reparse(&tokens, from, to, CharTokenizer::edit(insert), &pos);
+      std::string edited = text.substr(0, from) + insert + text.substr(to);
+      CharTokenizer fresh(edited);
+      std::string reparsed = std::to_string(ok) + " " + (ok ? std::to_string(pos) : "-");
+      std::string parsed = run(plain, NULL, NULL, &fresh);
+      parsed = parsed.substr(0, parsed.rfind(' '));
+      if (reparsed != parsed && mismatches++ < 10)
+        std::printf("grammar %u input '%s' edited to '%s': reparse gives %s, expected %s\n", seed, text.c_str(), edited.c_str(), reparsed.c_str(), parsed.c_str());
+    }
+  }
+  std::printf("%zu grammars, %zu inputs, %zu accepted, %zu mismatches\n", GRAMMARS, parses, oks, mismatches);
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,119 @@
+//      action.h
+//
+//      Action class stores an action closure [&]{ ... } in place
+//
+//      Action act = [&]{ a += b; };
+//      act(); // execute the closure
+//
+//      The closure is copied into a fixed-size buffer inside the Action, so
+//      an Action never allocates, and copying an Action, as building a
+//      grammar does for each clone of a node, copies the closure in place.
+//      The call goes through a function pointer to a thunk that is
+//      instantiated for the closure's type, an indirect call as with
+//      std::function, so calls cost about the same as before.
+//
+//      A closure larger than Action::SIZE bytes is rejected at compile time.
+//      Capture by reference [&] to keep closures small, since a closure that
+//      captures by reference holds at most one pointer per variable used.
+
+#ifndef ACTIONS
+#define ACTIONS
+
+#include <cstddef>
+#include <new>         // placement new
+#include <type_traits> // std::aligned_storage, std::enable_if
+
+class Action
+{
+  public:
+    static const size_t SIZE = 8 * sizeof(void*); ///< max size of a closure
+
+    Action()
+      :
+        call_(NULL),
+        ops_(NULL)
+    { }
+    template<typename F, typename = typename std::enable_if<!std::is_same<F,Action>::value>::type>
+    Action(const F& fun)
+      :
+        call_(&call<F>),
+        ops_(&ops<F>())
+    {
+      static_assert(sizeof(F) <= SIZE, "action closure is too large, capture by reference [&]");
+      static_assert(alignof(F) <= alignof(Buffer), "action closure is overaligned");
+      new (&buf_) F(fun);
+    }
+    Action(const Action& act)
+      :
+        call_(act.call_),
+        ops_(act.ops_)
+    {
+      if (ops_)
+        ops_->copy(&buf_, &act.buf_);
+    }
+    ~Action()
+    {
+      if (ops_)
+        ops_->destroy(&buf_);
+    }
+    Action& operator=(const Action& act)
+    {
+      if (this != &act)
+      {
+        if (ops_)
+          ops_->destroy(&buf_);
+        call_ = act.call_;
+        ops_ = act.ops_;
+        if (ops_)
+          ops_->copy(&buf_, &act.buf_);
+      }
+      return *this;
+    }
+    /// execute the closure
+    void operator()() const
+    {
+      call_(&buf_);
+    }
+    /// returns true if the action has a closure
+    explicit operator bool() const
+    {
+      return call_ != NULL;
+    }
+
+  protected:
+
+    typedef typename std::aligned_storage<SIZE>::type Buffer;
+    // copy and destroy the closure stored in a buffer
+    struct Ops
+    {
+      void (*copy)(void *to, const void *from);
+      void (*destroy)(void *buf);
+    };
+    template<typename F>
+    static void call(void *buf)
+    {
+      (*static_cast<F*>(buf))();
+    }
+    template<typename F>
+    static void copy(void *to, const void *from)
+    {
+      new (to) F(*static_cast<const F*>(from));
+    }
+    template<typename F>
+    static void destroy(void *buf)
+    {
+      static_cast<F*>(buf)->~F();
+    }
+    template<typename F>
+    static const Ops& ops()
+    {
+      static const Ops o = { &copy<F>, &destroy<F> };
+      return o;
+    }
+
+    void        (*call_)(void*); // thunk that calls the closure
+    const Ops    *ops_;          // thunks that copy and destroy the closure
+    mutable Buffer buf_;         // closure
+};
+
+#endif
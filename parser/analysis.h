@@ -0,0 +1,311 @@
+//      analysis.h
+//
+//      Computes FIRST sets and nullability of a grammar's nodes
+//
+//      Analysis an(&start); // analyze the grammar of nonterminal start
+//      an.index();          // index alternations by the FIRST sets of their alternatives
+//
+//      An indexed alternation (X|Y|...) looks up the code of the current token
+//      and only tries the alternatives that can match it, in their original
+//      order.  An alternative is skipped only when it would fail on the
+//      current token without side effects, so the parse remains PEG-ordered
+//      when FIRST sets overlap.  Alternatives that are nullable or that may
+//      run an action or update a flow variable before matching a token are
+//      always tried, as are alternatives that start with a lookahead that
+//      may run an action or update a flow variable anywhere in its body.
+//
+//      Index the grammar after it is complete, and before compiling a Program
+//      for it.
+//
+//      A definition is left-recursive when it can parse itself again before
+//      consuming a token.  Program uses left_recursive() to leave such
+//      definitions to Parser::parse(), which grows their seed parses.
+
+#ifndef ANALYSIS
+#define ANALYSIS
+
+#include <map>
+#include <set>
+#include <vector>
+#include "parser.h"
+
+class Analysis
+{
+  friend class Optimizer;
+
+  public:
+    /// FIRST set and nullability of a node
+    struct First
+    {
+      First()
+        :
+          nullable(false),
+          opaque(false)
+      { }
+      std::set<int> codes;    ///< codes of the tokens the node can start with
+      bool          nullable; ///< node can succeed without consuming a token
+      bool          opaque;   ///< node can have side effects before it consumes a token
+    };
+    explicit Analysis(BaseParser *start)
+    {
+      visit(start);
+      // iterate to a fixed point, since nonterminals may be (mutually) recursive
+      bool changed = true;
+      while (changed)
+      {
+        changed = false;
+        for (auto def : defs_)
+        {
+          First f = alternation(def->arg_);
+          First& g = first_[def];
+          if (f.codes != g.codes || f.nullable != g.nullable || f.opaque != g.opaque)
+          {
+            g = f;
+            changed = true;
+          }
+        }
+      }
+    }
+    /// returns the FIRST set and nullability of a node of the grammar
+    First first(const BaseParser *arg) const
+    {
+      switch (arg->tag_)
+      {
+        case BaseParser::Tag::DEF:
+        {
+          auto f = first_.find(arg);
+          return f != first_.end() ? f->second : First();
+        }
+        case BaseParser::Tag::NON:
+        {
+          First f = first(arg->get_def());
+          f.opaque |= swaps(arg);
+          return f;
+        }
+        case BaseParser::Tag::TOK:
+        {
+          First f;
+          if (arg->set_)
+            f.codes.insert(arg->set_->codes().begin(), arg->set_->codes().end());
+          else
+            f.codes.insert(arg->tok_code);
+          return f;
+        }
+        case BaseParser::Tag::ACT:
+        {
+          First f;
+          f.nullable = true;
+          f.opaque = true;
+          return f;
+        }
+        case BaseParser::Tag::SEQ:
+        case BaseParser::Tag::ALT:
+        {
+          First f = arg->tag_ == BaseParser::Tag::SEQ ? sequence(arg->arg_) : alternation(arg->arg_);
+          if (arg->max_ == 0)
+          {
+            // lookahead consumes no tokens and constrains the next token only when positive,
+            // but runs the actions of its body, also those after its first token
+            if (arg->min_ == 0)
+              f.codes.clear();
+            f.nullable = true;
+            f.opaque |= effects(arg);
+          }
+          else if (arg->min_ == 0)
+          {
+            f.nullable = true;
+          }
+          return f;
+        }
+      }
+      return First();
+    }
+    /// returns the definitions reachable from start
+    const std::vector<BaseParser*>& definitions() const
+    {
+      return defs_;
+    }
+    /// returns true if the definition can be parsed again at the position of its parse (left recursion)
+    bool left_recursive(const BaseParser *def) const
+    {
+      std::set<const BaseParser*> seen;
+      std::vector<const BaseParser*> todo(1, def);
+      while (!todo.empty())
+      {
+        const BaseParser *d = todo.back();
+        todo.pop_back();
+        std::vector<const BaseParser*> calls;
+        for (auto a : d->arg_)
+          left_calls(a, calls);
+        for (auto c : calls)
+        {
+          if (c == def)
+            return true;
+          if (seen.insert(c).second)
+            todo.push_back(c);
+        }
+      }
+      return false;
+    }
+    /// index the alternations of the grammar, returns the number of alternations indexed
+    size_t index()
+    {
+      size_t n = 0;
+      for (auto alt : alts_)
+      {
+        std::vector<First> firsts;
+        std::set<int> codes;
+        for (auto a : alt->arg_)
+        {
+          firsts.push_back(first(a));
+          codes.insert(firsts.back().codes.begin(), firsts.back().codes.end());
+        }
+        BaseParser::Index *idx = new BaseParser::Index;
+        for (size_t k = 0; k < firsts.size(); ++k)
+          if (firsts[k].nullable || firsts[k].opaque)
+            idx->other.push_back(alt->arg_[k]);
+        // an index that never skips an alternative is not worth a lookup
+        bool skips = idx->other.size() < alt->arg_.size();
+        for (auto c : codes)
+        {
+          BaseParser::Nodes& alts = idx->alts[c];
+          for (size_t k = 0; k < firsts.size(); ++k)
+            if (firsts[k].nullable || firsts[k].opaque || firsts[k].codes.count(c))
+              alts.push_back(alt->arg_[k]);
+          skips |= alts.size() < alt->arg_.size();
+        }
+        if (skips)
+        {
+          alt->idx_.reset(idx);
+          ++n;
+        }
+        else
+        {
+          alt->idx_.reset();
+          delete idx;
+        }
+      }
+      return n;
+    }
+
+  protected:
+
+    // collect the definitions and alternations reachable from arg
+    void visit(BaseParser *arg)
+    {
+      if (!visited_.insert(arg).second)
+        return;
+      if (arg->tag_ == BaseParser::Tag::DEF)
+        defs_.push_back(arg);
+      else if (arg->tag_ == BaseParser::Tag::NON)
+        visit(const_cast<BaseParser*>(arg->get_def())); // a NON's def is never const
+      else if (arg->tag_ == BaseParser::Tag::ALT && arg->arg_.size() > 1)
+        alts_.push_back(arg);
+      for (auto a : arg->arg_)
+        visit(a);
+    }
+    // collect the definitions arg can parse before consuming a token
+    void left_calls(const BaseParser *arg, std::vector<const BaseParser*>& calls) const
+    {
+      switch (arg->tag_)
+      {
+        case BaseParser::Tag::DEF:
+          calls.push_back(arg);
+          break;
+        case BaseParser::Tag::NON:
+          calls.push_back(arg->get_def());
+          break;
+        case BaseParser::Tag::SEQ:
+          for (auto a : arg->arg_)
+          {
+            left_calls(a, calls);
+            if (!first(a).nullable)
+              break;
+          }
+          break;
+        case BaseParser::Tag::ALT:
+          for (auto a : arg->arg_)
+            left_calls(a, calls);
+          break;
+        default:
+          break;
+      }
+    }
+    First sequence(const BaseParser::Nodes& args) const
+    {
+      First f;
+      f.nullable = true;
+      for (auto a : args)
+      {
+        First g = first(a);
+        f.codes.insert(g.codes.begin(), g.codes.end());
+        f.opaque |= g.opaque;
+        if (!g.nullable)
+        {
+          f.nullable = false;
+          break;
+        }
+      }
+      return f;
+    }
+    First alternation(const BaseParser::Nodes& args) const
+    {
+      First f;
+      for (auto a : args)
+      {
+        First g = first(a);
+        f.codes.insert(g.codes.begin(), g.codes.end());
+        f.nullable |= g.nullable;
+        f.opaque |= g.opaque;
+      }
+      return f;
+    }
+    // returns true if the parse of arg can run an action or leave a value in a flow variable
+    bool effects(const BaseParser *arg) const
+    {
+      auto e = effects_.find(arg);
+      if (e != effects_.end())
+        return e->second;
+      std::set<const BaseParser*> seen;
+      return effects_[arg] = effects(arg, seen);
+    }
+    bool effects(const BaseParser *arg, std::set<const BaseParser*>& seen) const
+    {
+      switch (arg->tag_)
+      {
+        case BaseParser::Tag::DEF:
+          if (!seen.insert(arg).second)
+            return false;
+          break;
+        case BaseParser::Tag::NON:
+          return swaps(arg) || effects(arg->get_def(), seen);
+        case BaseParser::Tag::TOK:
+          return false;
+        case BaseParser::Tag::ACT:
+          return true;
+        default:
+          break;
+      }
+      for (auto a : arg->arg_)
+        if (effects(a, seen))
+          return true;
+      return false;
+    }
+    // a NON that fails still leaves values in its out-flow variable, and in its
+    // in-flow variable when its definition uses the same variable for in and out
+    static bool swaps(const BaseParser *non)
+    {
+      const BaseParser *def = non->get_def();
+      if (def->get_out() && def->get_out() != non->get_out())
+        return true;
+      return def->get_in() && def->get_in() == def->get_out() && def->get_in() != non->get_in();
+    }
+
+    std::set<const BaseParser*>              visited_; // nodes visited
+    std::vector<BaseParser*>                 defs_;    // definitions reachable from start
+    std::vector<BaseParser*>                 alts_;    // alternations reachable from start
+    std::map<const BaseParser*,First>        first_;   // FIRST sets of definitions
+    mutable std::map<const BaseParser*,bool> effects_; // lookaheads that can run an action or leave a value in a flow variable
+};
+
+#endif
@@ -0,0 +1,189 @@
+//      context.h
+//
+//      Context class holds the mutable state of parses of frozen grammars
+//
+//      start.freeze();              // the grammar of start no longer changes
+//      Context ctx;                 // one context per thread
+//      start.parse(ctx, &tokens);   // parse with the state kept in ctx
+//
+//      A frozen grammar keeps no state of its own during a parse: memoized
+//      results, active left recursions and the counters of the parsing engine
+//      are kept in the Context of the parse.  Threads that parse with their
+//      own Context may thus share one frozen grammar.  A Context is reused by
+//      the next parse, and must not be used by two parses at the same time.
+//
+//      Parses without a Context use a default Context of their thread.
+//
+//      The flow values a frozen grammar saves while its nonterminals are
+//      active are kept in the Context too.  The flow variables themselves are
+//      the program's variables, which the actions read and write, so they
+//      are shared by all parses of a grammar: threads parse a frozen grammar
+//      with flow variables, such as calc's, in turn, e.g. under a mutex,
+//      while each Context keeps its own memoized results.
+//
+//      A frozen definition, and a frozen node with flow variables, takes a
+//      slot number of the process.  The number is reused after the node is
+//      destroyed, and each Context drops the state it kept for the node at
+//      its next parse, so creating and destroying frozen grammars, e.g. per
+//      tenant, does not grow the Contexts of the process.
+//
+//      A Context also records the farthest position at which the current
+//      parse failed to match a token, for the Result of the parse.
+
+#ifndef CONTEXT
+#define CONTEXT
+
+#include <atomic>
+#include <cstddef>
+#include <memory>  // std::unique_ptr
+#include <mutex>
+#include <vector>
+
+class BaseParser;
+
+class Context
+{
+  friend class BaseParser;
+  template<typename,typename> friend class Parser;
+  friend class Program;
+
+  public:
+    Context()
+      :
+        parses_(0),
+        depth_(0),
+        seeded_(~static_cast<size_t>(0)),
+        limit_(~static_cast<size_t>(0)),
+        farthest_(0),
+        reach_(0),
+        releases_(0)
+    { }
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    /// release the memoized results of previous parses
+    void clear()
+    {
+      slots_.clear();
+    }
+
+  protected:
+
+    // state of a frozen definition, or flow values of a frozen node
+    struct Slot
+    {
+      Slot()
+        :
+          generation(0)
+      { }
+      virtual ~Slot()
+      { }
+      size_t generation; // generation of the slot number the state was created for
+    };
+    // slot numbers of the process
+    struct Registry
+    {
+      Registry()
+        :
+          releases(0)
+      { }
+      std::mutex          mutex;       // guards free and generations
+      std::vector<size_t> free;        // released slot numbers to reuse
+      std::vector<size_t> generations; // number of times each slot number was released
+      std::atomic<size_t> releases;    // number of slot numbers released
+    };
+    // makes a context the current context of its thread for the lifetime of a Use
+    class Use
+    {
+      public:
+        explicit Use(Context& ctx)
+          :
+            prev_(current())
+        {
+          current() = &ctx;
+        }
+        ~Use()
+        {
+          current() = prev_;
+        }
+      protected:
+        Context *prev_;
+    };
+
+    // returns the current context of this thread, the thread's default context when no parse uses one
+    static Context*& current()
+    {
+      static thread_local Context base;
+      static thread_local Context *ctx = &base;
+      return ctx;
+    }
+    // returns the slot numbers of the process, never destroyed, as static parsers may release slots at exit
+    static Registry& registry()
+    {
+      static Registry *reg = new Registry;
+      return *reg;
+    }
+    // returns a slot number that no live definition uses
+    static size_t allocate()
+    {
+      Registry& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      if (reg.free.empty())
+      {
+        reg.generations.push_back(0);
+        return reg.generations.size() - 1;
+      }
+      size_t k = reg.free.back();
+      reg.free.pop_back();
+      return k;
+    }
+    // release the slot number of a destroyed definition, Contexts drop its state at their next parse
+    static void release(size_t k)
+    {
+      Registry& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      ++reg.generations[k];
+      reg.free.push_back(k);
+      ++reg.releases;
+    }
+    // drop the states of the slot numbers released since the last call, called when a top-level parse starts
+    void expire()
+    {
+      Registry& reg = registry();
+      if (reg.releases.load() == releases_)
+        return;
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      releases_ = reg.releases.load();
+      for (size_t k = 0; k < slots_.size(); ++k)
+        if (slots_[k] && slots_[k]->generation != reg.generations[k])
+          slots_[k].reset();
+      while (!slots_.empty() && !slots_.back())
+        slots_.pop_back();
+    }
+    // returns the state of slot k, constructed on first use
+    template<typename T>
+    T& slot(size_t k)
+    {
+      if (k >= slots_.size())
+        slots_.resize(k + 1);
+      if (!slots_[k])
+      {
+        Registry& reg = registry();
+        slots_[k].reset(new T());
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        slots_[k]->generation = reg.generations[k];
+      }
+      return static_cast<T&>(*slots_[k]);
+    }
+
+    size_t                              parses_;   // number of top-level parses, to expire memoized results
+    size_t                              depth_;    // number of active definition parses
+    size_t                              seeded_;   // least depth of a left recursion with a seed in use, or MAX
+    size_t                              limit_;    // max number of active definition parses, MAX when unlimited
+    std::vector<std::unique_ptr<Slot> > slots_;    // states of frozen nodes by slot number
+    size_t                              farthest_; // farthest position at which a node failed to match a token
+    std::vector<const BaseParser*>      expected_; // nodes that failed to match a token at farthest_
+    size_t                              reach_;    // position after the last token looked at by the innermost definition parse
+    size_t                              releases_; // number of slot numbers released when the states were last expired
+};
+
+#endif
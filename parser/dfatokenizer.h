@@ -0,0 +1,688 @@
+//      dfatokenizer.h
+//
+//      Constructs an on-demand container of Tokens with a DFA built from regex
+//      rules in C++, without generating a scanner with Flex
+//
+//      Lexer lexer({                                            // as calc.l:
+//        { "[-+*/=()\n]", Lexer::SELF },                        // return *yytext
+//        { "[0-9]*([0-9]|\\.[0-9]|[0-9]\\.)[0-9]*", NUM },       // return NUM
+//        { ".", Lexer::SKIP },                                  // do nothing
+//      });
+//      DFATokenizer tokens(&lexer, text);                       // scan text
+//
+//      Like Flex, the scanner matches the longest lexeme at the current
+//      position, and the first rule when rules match lexemes of the same
+//      length.  A rule returns its token code, or the code of the first
+//      character of the lexeme (SELF), or skips the lexeme (SKIP).  A
+//      character that no rule matches is skipped.
+//
+//      The rules are regular expressions in the syntax of Flex: characters,
+//      "quoted strings", escapes \n \t \r \f \v \a \b \0 \xHH, classes [a-z]
+//      and [^a-z], any character except newline ., grouping ( ), alternation
+//      |, and repeats * + ? {n} {n,} {n,m}.  Name definitions are written with
+//      C++ string concatenation instead of {name}.  Anchors ^ $ and trailing
+//      context / are not supported and must be escaped to match themselves.
+//
+//      The Lexer compiles the rules to a minimal DFA with a transition table
+//      indexed by state and by byte class, the bytes that no rule
+//      distinguishes.  It does not change after construction, so tokenizers
+//      of any number of threads can share it.
+//
+//      The lexemes of tokens refer to the scanned text, which must outlive the
+//      tokenizer unless the tokenizer is constructed from a std::string, of
+//      which it keeps a copy.  Runs of characters that are skipped one at a
+//      time, such as white space, are skipped without running the DFA, with
+//      SSE2 when there are at most four such characters.
+
+#ifndef DFATOKENIZER
+#define DFATOKENIZER
+
+#include <algorithm>        // std::sort()
+#include <bitset>
+#include <cctype>           // isxdigit()
+#include <cstring>          // memchr()
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "tokenizer.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+class Lexer
+{
+  friend class DFATokenizer;
+
+  public:
+    static const int SELF = -1; ///< rule returns the code of the first character of its lexeme
+    static const int SKIP = 0;  ///< rule skips its lexeme
+
+    /// a regular expression and its token code, SELF or SKIP
+    struct Rule
+    {
+      const char *regex;
+      int         code;
+    };
+
+    /// compile the rules, throws std::invalid_argument when a regex is invalid
+    Lexer(std::initializer_list<Rule> rules)
+    {
+      for (auto& r : rules)
+        codes_.push_back(r.code);
+      Nfa nfa;
+      int start = nfa.state();
+      int k = 0;
+      for (auto& r : rules)
+      {
+        Regex re(nfa, r.regex, k);
+        Frag f = re.parse();
+        nfa.states[start].eps.push_back(f.start);
+        nfa.states[f.end].rule = k++;
+      }
+      build(nfa, start);
+    }
+    /// returns the number of states of the DFA, including the dead state
+    size_t states() const
+    {
+      return next_.size() / (classes_ + 1);
+    }
+    /// returns the number of byte classes of the DFA
+    size_t classes() const
+    {
+      return classes_;
+    }
+
+  protected:
+
+    // NFA with epsilon transitions and at most one transition on a set of bytes per state
+    struct Nfa
+    {
+      struct State
+      {
+        State() : next(-1), rule(-1)
+        { }
+        std::vector<int>  eps;  // epsilon transitions
+        std::bitset<256>  set;  // bytes of the transition to next
+        int               next; // target of the transition on set, or -1
+        int               rule; // rule accepted in this state, or -1
+      };
+      int state()
+      {
+        states.push_back(State());
+        return static_cast<int>(states.size() - 1);
+      }
+      std::vector<State> states;
+    };
+    // fragment of an NFA with one start and one end state
+    struct Frag
+    {
+      int start;
+      int end;
+    };
+
+    // parses a regex into an NFA fragment
+    class Regex
+    {
+      public:
+        Regex(Nfa& nfa, const char *regex, int rule)
+          :
+            nfa_(nfa),
+            re_(regex),
+            pos_(0),
+            rule_(rule)
+        { }
+        Frag parse()
+        {
+          Frag f = alternation();
+          if (re_[pos_] != '\0')
+            error("unbalanced )");
+          return f;
+        }
+      protected:
+        Frag alternation()
+        {
+          Frag f = sequence();
+          while (re_[pos_] == '|')
+          {
+            ++pos_;
+            Frag g = sequence();
+            Frag h = { nfa_.state(), nfa_.state() };
+            eps(h.start, f.start);
+            eps(h.start, g.start);
+            eps(f.end, h.end);
+            eps(g.end, h.end);
+            f = h;
+          }
+          return f;
+        }
+        Frag sequence()
+        {
+          int s = nfa_.state();
+          Frag f = { s, s };
+          while (re_[pos_] != '\0' && re_[pos_] != '|' && re_[pos_] != ')')
+          {
+            Frag g = repeat();
+            eps(f.end, g.start);
+            f.end = g.end;
+          }
+          return f;
+        }
+        Frag repeat()
+        {
+          size_t at = pos_;
+          Frag f = atom();
+          while (true)
+          {
+            char c = re_[pos_];
+            if (c == '*' || c == '+' || c == '?')
+            {
+              ++pos_;
+              Frag h = { nfa_.state(), nfa_.state() };
+              eps(h.start, f.start);
+              eps(f.end, h.end);
+              if (c != '+')
+                eps(h.start, h.end);
+              if (c != '?')
+                eps(f.end, f.start);
+              f = h;
+            }
+            else if (c == '{' && re_[pos_ + 1] >= '0' && re_[pos_ + 1] <= '9')
+            {
+              ++pos_;
+              size_t n = number(), m = n;
+              bool inf = false;
+              if (re_[pos_] == ',')
+              {
+                ++pos_;
+                if (re_[pos_] == '}')
+                  inf = true;
+                else
+                  m = number();
+              }
+              if (re_[pos_] != '}' || m < n)
+                error("invalid repeat");
+              size_t end = ++pos_;
+              // a repeat of the atom concatenates copies, parsed again from the atom's text
+              int s = nfa_.state();
+              Frag g = { s, s };
+              for (size_t k = 0; k < (inf ? n + 1 : m); ++k)
+              {
+                Frag c = k == 0 ? f : copy(at);
+                if (inf && k == n)
+                {
+                  eps(c.end, c.start); // last copy repeats
+                  eps(g.end, c.end);
+                }
+                else if (k >= n)
+                {
+                  eps(c.start, c.end); // copies after the first n are optional
+                }
+                eps(g.end, c.start);
+                g.end = c.end;
+              }
+              pos_ = end;
+              f = g;
+            }
+            else
+            {
+              return f;
+            }
+          }
+        }
+        // parse a copy of the atom at position at
+        Frag copy(size_t at)
+        {
+          size_t pos = pos_;
+          pos_ = at;
+          Frag f = atom();
+          pos_ = pos;
+          return f;
+        }
+        Frag atom()
+        {
+          std::bitset<256> set;
+          char c = re_[pos_++];
+          switch (c)
+          {
+            case '(':
+            {
+              Frag f = alternation();
+              if (re_[pos_] != ')')
+                error("missing )");
+              ++pos_;
+              return f;
+            }
+            case '[':
+              set = bracket();
+              break;
+            case '.':
+              set.set();
+              set.reset('\n');
+              break;
+            case '"':
+            {
+              int s = nfa_.state();
+              Frag f = { s, s };
+              while (re_[pos_] != '"')
+              {
+                if (re_[pos_] == '\0')
+                  error("missing \"");
+                std::bitset<256> b;
+                b.set(static_cast<unsigned char>(re_[pos_] == '\\' ? (++pos_, escape()) : re_[pos_++]));
+                Frag g = bytes(b);
+                eps(f.end, g.start);
+                f.end = g.end;
+              }
+              ++pos_;
+              return f;
+            }
+            case '\\':
+              set.set(static_cast<unsigned char>(escape()));
+              break;
+            case '*': case '+': case '?': case '{': case ')':
+              error("nothing to repeat or unbalanced )");
+            case '^': case '$': case '/':
+              error("anchors and trailing context are not supported");
+            default:
+              set.set(static_cast<unsigned char>(c));
+          }
+          return bytes(set);
+        }
+        // parse a class after its [
+        std::bitset<256> bracket()
+        {
+          std::bitset<256> set;
+          bool neg = re_[pos_] == '^';
+          if (neg)
+            ++pos_;
+          bool first = true;
+          while (re_[pos_] != ']' || first)
+          {
+            if (re_[pos_] == '\0')
+              error("missing ]");
+            first = false;
+            unsigned char lo = member();
+            unsigned char hi = lo;
+            if (re_[pos_] == '-' && re_[pos_ + 1] != ']' && re_[pos_ + 1] != '\0')
+            {
+              ++pos_;
+              hi = member();
+              if (hi < lo)
+                error("invalid range");
+            }
+            for (unsigned c = lo; c <= hi; ++c)
+              set.set(c);
+          }
+          ++pos_;
+          if (neg)
+            set.flip();
+          return set;
+        }
+        unsigned char member()
+        {
+          char c = re_[pos_++];
+          return static_cast<unsigned char>(c == '\\' ? escape() : c);
+        }
+        // parse an escape after its backslash
+        char escape()
+        {
+          char c = re_[pos_++];
+          switch (c)
+          {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'v': return '\v';
+            case 'a': return '\a';
+            case 'b': return '\b';
+            case '0': return '\0';
+            case 'x':
+            {
+              int v = 0;
+              for (int k = 0; k < 2 && isxdigit(static_cast<unsigned char>(re_[pos_])); ++k)
+              {
+                char d = re_[pos_++];
+                v = 16 * v + (d <= '9' ? d - '0' : (d | 0x20) - 'a' + 10);
+              }
+              return static_cast<char>(v);
+            }
+            case '\0':
+              error("trailing \\");
+          }
+          return c;
+        }
+        size_t number()
+        {
+          size_t n = 0;
+          while (re_[pos_] >= '0' && re_[pos_] <= '9')
+            n = 10 * n + (re_[pos_++] - '0');
+          return n;
+        }
+        Frag bytes(const std::bitset<256>& set)
+        {
+          Frag f = { nfa_.state(), nfa_.state() };
+          nfa_.states[f.start].set = set;
+          nfa_.states[f.start].next = f.end;
+          return f;
+        }
+        void eps(int from, int to)
+        {
+          nfa_.states[from].eps.push_back(to);
+        }
+        [[noreturn]] void error(const char *what) const
+        {
+          throw std::invalid_argument(std::string("Lexer: ") + what + " in rule " + std::to_string(rule_) + ": " + re_);
+        }
+
+        Nfa&        nfa_;
+        const char *re_;
+        size_t      pos_;
+        int         rule_;
+    };
+
+    // build the minimal DFA of the NFA with subset construction and partition refinement
+    void build(const Nfa& nfa, int start)
+    {
+      // bytes that no transition distinguishes share a class
+      std::vector<int> cls(256, 0);
+      int n = 1;
+      for (auto& s : nfa.states)
+      {
+        if (s.next < 0)
+          continue;
+        std::map<std::pair<int,bool>,int> split;
+        for (int c = 0; c < 256; ++c)
+        {
+          auto k = std::make_pair(cls[c], static_cast<bool>(s.set[c]));
+          auto i = split.find(k);
+          if (i == split.end())
+            i = split.insert(std::make_pair(k, static_cast<int>(split.size()))).first;
+          cls[c] = i->second;
+        }
+        n = static_cast<int>(split.size());
+      }
+      classes_ = n;
+      std::vector<int> rep(n);
+      for (int c = 255; c >= 0; --c)
+        rep[cls[c]] = c;
+
+      // subset construction, state 0 is the dead state
+      std::map<std::vector<int>,int> ids;
+      std::vector<std::vector<int> > sets;
+      std::vector<int> next;
+      std::vector<int> accept;
+      auto intern = [&](std::vector<int>& set) -> int {
+        closure(nfa, set);
+        auto i = ids.find(set);
+        if (i != ids.end())
+          return i->second;
+        int id = static_cast<int>(sets.size());
+        ids[set] = id;
+        sets.push_back(set);
+        int rule = -1;
+        for (auto s : set)
+          if (nfa.states[s].rule >= 0 && (rule < 0 || nfa.states[s].rule < rule))
+            rule = nfa.states[s].rule;
+        accept.push_back(rule);
+        return id;
+      };
+      std::vector<int> none;
+      intern(none);
+      std::vector<int> first(1, start);
+      int q0 = intern(first);
+      for (size_t q = 0; q < sets.size(); ++q)
+      {
+        next.resize((q + 1) * n);
+        for (int c = 0; c < n; ++c)
+        {
+          std::vector<int> to;
+          for (auto s : sets[q])
+            if (nfa.states[s].next >= 0 && nfa.states[s].set[rep[c]])
+              to.push_back(nfa.states[s].next);
+          int t = intern(to);
+          next[q * n + c] = t;
+        }
+      }
+
+      // partition refinement of the states by accepted rule and by the blocks of their successors
+      size_t m = sets.size();
+      std::vector<int> block(m);
+      size_t blocks = 0;
+      {
+        std::map<int,int> by;
+        for (size_t q = 0; q < m; ++q)
+        {
+          auto i = by.insert(std::make_pair(q == 0 ? -2 : accept[q], static_cast<int>(by.size()))).first;
+          block[q] = i->second;
+        }
+        blocks = by.size();
+      }
+      while (true)
+      {
+        std::map<std::vector<int>,int> by;
+        std::vector<int> refined(m);
+        for (size_t q = 0; q < m; ++q)
+        {
+          std::vector<int> sig(1, block[q]);
+          for (int c = 0; c < n; ++c)
+            sig.push_back(block[next[q * n + c]]);
+          auto i = by.insert(std::make_pair(sig, static_cast<int>(by.size()))).first;
+          refined[q] = i->second;
+        }
+        block.swap(refined);
+        if (by.size() == blocks)
+          break;
+        blocks = by.size();
+      }
+
+      // renumber the blocks so that the dead state is 0, a state is a row of the transitions by class and its accepted rule
+      std::vector<int> id(blocks, -1);
+      int k = 0;
+      id[block[0]] = k++;
+      for (size_t q = 0; q < m; ++q)
+        if (id[block[q]] < 0)
+          id[block[q]] = k++;
+      int w = n + 1;
+      next_.assign(blocks * w, 0);
+      for (size_t q = 0; q < m; ++q)
+      {
+        int b = id[block[q]] * w;
+        for (int c = 0; c < n; ++c)
+          next_[b + c] = id[block[next[q * n + c]]] * w;
+        next_[b + n] = accept[q];
+      }
+      start_ = id[block[q0]] * w;
+      for (int c = 0; c < 256; ++c)
+        class_[c] = static_cast<unsigned short>(cls[c]);
+
+      // bytes that are skipped one at a time: a SKIP rule accepts them and no longer lexeme starts with them
+      for (int c = 0; c < 256; ++c)
+      {
+        int t = next_[start_ + cls[c]];
+        bool skip = t != 0 && next_[t + n] >= 0 && codes_[next_[t + n]] == SKIP;
+        for (int d = 0; skip && d < n; ++d)
+          if (next_[t + d] != 0)
+            skip = false;
+        skip_[c] = skip;
+        if (skip)
+          spaces_.push_back(static_cast<char>(c));
+      }
+    }
+    // add the states reachable with epsilon transitions to the sorted set
+    static void closure(const Nfa& nfa, std::vector<int>& set)
+    {
+      std::vector<bool> in(nfa.states.size(), false);
+      std::vector<int> todo(set);
+      set.clear();
+      while (!todo.empty())
+      {
+        int s = todo.back();
+        todo.pop_back();
+        if (in[s])
+          continue;
+        in[s] = true;
+        set.push_back(s);
+        for (auto t : nfa.states[s].eps)
+          todo.push_back(t);
+      }
+      std::sort(set.begin(), set.end());
+    }
+
+    std::vector<int> codes_;       // token codes of the rules
+    std::vector<int> next_;        // rows of states: the rows of the targets by byte class, then the rule accepted or -1
+    unsigned short   class_[256];  // byte classes
+    size_t           classes_;     // number of byte classes
+    int              start_;       // row of the start state, the dead state is row 0
+    bool             skip_[256];   // bytes that are skipped one at a time
+    std::string      spaces_;      // the bytes of skip_
+};
+
+class DFATokenizer : public Tokenizer
+{
+  public:
+    /// scan the text, which must outlive the tokenizer
+    DFATokenizer(const Lexer *lexer, const char *text, size_t size)
+    {
+      start(lexer, text, size);
+    }
+    /// scan the 0-terminated text, which must outlive the tokenizer
+    DFATokenizer(const Lexer *lexer, const char *text)
+    {
+      start(lexer, text, strlen(text));
+    }
+    /// scan a copy of the string
+    DFATokenizer(const Lexer *lexer, const std::string& text)
+      :
+        copy_(text)
+    {
+      start(lexer, copy_.data(), copy_.size());
+    }
+    DFATokenizer(const DFATokenizer&) = delete;
+    DFATokenizer& operator=(const DFATokenizer&) = delete;
+    virtual bool has_pos(size_t pos)
+    {
+      if (pos >= size())
+        fill_to(pos);
+      return Tokenizer::has_pos(pos);
+    }
+    virtual Token at(size_t pos)
+    {
+      if (pos >= size())
+        fill_to(pos);
+      return Tokenizer::at(pos);
+    }
+
+  private:
+    void start(const Lexer *lexer, const char *text, size_t size)
+    {
+      lexer_ = lexer;
+      next_ = text;
+      end_ = text + size;
+      scanned_ = text;
+      lineno_ = 1;
+      columno_ = 0;
+    }
+    void fill_to(size_t pos)
+    {
+      const Lexer& lx = *lexer_;
+      const int *next = lx.next_.data();
+      size_t n = lx.classes_;
+      while (pos >= size())
+      {
+        skip();
+        if (next_ >= end_)
+          return;
+        // longest match
+        const char *s = next_;
+        const char *last = NULL;
+        int rule = -1;
+        int q = lx.start_;
+        while (s < end_)
+        {
+          q = next[q + lx.class_[static_cast<unsigned char>(*s)]];
+          if (q == 0)
+            break;
+          ++s;
+          if (next[q + n] >= 0)
+          {
+            last = s;
+            rule = next[q + n];
+          }
+        }
+        if (last == NULL)
+        {
+          ++next_; // no rule matches this character
+          continue;
+        }
+        const char *text = next_;
+        next_ = last;
+        int code = lx.codes_[rule];
+        if (code == Lexer::SKIP)
+          continue;
+        if (code == Lexer::SELF)
+          code = static_cast<unsigned char>(*text);
+        advance(text);
+        size_t lineno = lineno_, columno = columno_;
+        advance(last);
+        emplace_view(code, text, last - text, lineno, columno);
+      }
+    }
+    // skip the run of bytes at next_ that are skipped one at a time
+    void skip()
+    {
+      const Lexer& lx = *lexer_;
+      const char *s = next_;
+#ifdef __SSE2__
+      size_t k = lx.spaces_.size();
+      if (k > 0 && k <= 4)
+      {
+        __m128i c0 = _mm_set1_epi8(lx.spaces_[0]);
+        __m128i c1 = _mm_set1_epi8(lx.spaces_[k > 1 ? 1 : 0]);
+        __m128i c2 = _mm_set1_epi8(lx.spaces_[k > 2 ? 2 : 0]);
+        __m128i c3 = _mm_set1_epi8(lx.spaces_[k > 3 ? 3 : 0]);
+        while (s + 16 <= end_)
+        {
+          __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+          __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(b, c0), _mm_cmpeq_epi8(b, c1)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(b, c2), _mm_cmpeq_epi8(b, c3)));
+          unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(eq)) & 0xFFFF;
+          if (mask != 0)
+          {
+            next_ = s + __builtin_ctz(mask);
+            return;
+          }
+          s += 16;
+        }
+      }
+#endif
+      while (s < end_ && lx.skip_[static_cast<unsigned char>(*s)])
+        ++s;
+      next_ = s;
+    }
+    // count the lines and columns of the text scanned up to end
+    void advance(const char *end)
+    {
+      const char *s;
+      while ((s = static_cast<const char*>(memchr(scanned_, '\n', end - scanned_))) != NULL)
+      {
+        ++lineno_;
+        columno_ = 0;
+        scanned_ = s + 1;
+      }
+      columno_ += end - scanned_;
+      scanned_ = end;
+    }
+
+    std::string   copy_;    // copy of a string scanned
+    const Lexer  *lexer_;   // rules
+    const char   *next_;    // next character to scan
+    const char   *end_;     // end of the text
+    const char   *scanned_; // end of the text of which lines and columns are counted
+    size_t        lineno_;  // line number at scanned_
+    size_t        columno_; // column number at scanned_
+};
+
+#endif
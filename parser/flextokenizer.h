@@ -2,22 +2,66 @@
 //
 //      Constructs an on-demand (files only) container of Tokens from a Flex spec
 //
+//      Tokens are read from a file as the parser looks at them.  Call commit(pos)
+//      between parses of records to discard the tokens before pos, so that a
+//      stream is parsed in bounded memory, see tokenizer.h.
+//
+//      FlexTokenizer tokens("input.txt", FlexTokenizer::MAPPED);
+//
+//      maps a file into memory and scans it in place on demand, without
+//      reading the file first.  The lexemes of the tokens refer to the mapping
+//      instead of being copied, and are not 0-terminated.  The mapping is
+//      private, so the writes of the scanner to its buffer do not change the
+//      file.
+//
+//      The scanner writes a 0 byte after each lexeme it returns, and restores
+//      the byte at its next call, so each page of the file that holds the end
+//      of a lexeme is copied once by the kernel when it is first written.  A
+//      mapped file thus costs about a copy of the file scanned so far in
+//      private memory of the process, made page by page as the parser looks
+//      at tokens, instead of the read into a buffer and the copy of a string
+//      or FILE* tokenizer.  The copied pages remain until the FlexTokenizer
+//      is destroyed, also after commit(): to parse a stream larger than
+//      memory, scan a FILE* instead.
+//
+//      The scanner is reentrant: each FlexTokenizer owns its scanner, so any
+//      number of FlexTokenizers may scan at the same time, also in different
+//      threads.  Generate the scanner with %option reentrant in the spec:
+//
+//      %option noyywrap reentrant yylineno
+//
 //      flex lexertest.l
 //      cc -c lex.yy.c
 //	    c++ -std=c++11 -o lexertest lexertest.cpp lex.yy.o
 //
-//      or with reentrant (MT-safe) scanner:
+//      or with a non-reentrant scanner, of which one FlexTokenizer at a time
+//      may be in use, generated from a spec without %option reentrant:
 //
-//      flex -R lexertest.l
+//      flex lexertest.l
 //      cc -c lex.yy.c
-//	    c++ -std=c++11 -DFLEX_REENTRANT -o lexertest lexertest.cpp lex.yy.o
+//	    c++ -std=c++11 -DFLEX_NONREENTRANT -o lexertest lexertest.cpp lex.yy.o
+//
+//      The line and column of a token are those of the first character of its
+//      lexeme, counted from line 1 and column 0.  They are counted by the
+//      FlexTokenizer for strings and mapped files.  For a FILE*, the line is
+//      counted by the scanner with %option yylineno, and the column is the
+//      scanner's yycolumn, which the spec may maintain in YY_USER_ACTION.
 
 #ifndef ODFLEXTOKENIZER
 #define ODFLEXTOKENIZER
 
+#include <cstdio>
+#include <cstring>    // memchr(), memcpy()
+#include <memory>     // std::unique_ptr
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>    // open()
+#include <sys/mman.h> // mmap(), munmap(), madvise()
+#include <sys/stat.h> // fstat()
+#include <unistd.h>   // close(), sysconf()
 #include "tokenizer.h"
 
-#ifdef FLEX_REENTRANT
+#ifndef FLEX_NONREENTRANT
 
 /// Flex stuff (reentrant)
 typedef void *yyscan_t;
@@ -25,12 +69,12 @@ typedef void *YY_BUFFER_STATE;
 extern "C" int yylex_init(yyscan_t*);
 extern "C" int yylex_destroy(yyscan_t);
 extern "C" void yyset_in(FILE*, yyscan_t);
-extern "C" const char *yyget_text(yyscan_t);
-extern "C" size_t yyget_leng(yyscan_t);
+extern "C" char *yyget_text(yyscan_t);
+extern "C" int yyget_leng(yyscan_t);
 extern "C" int yyget_lineno(yyscan_t);
+extern "C" int yyget_column(yyscan_t);
 extern "C" int yylex(yyscan_t);
-extern "C" YY_BUFFER_STATE yy_scan_string(const char*, yyscan_t);
-extern "C" YY_BUFFER_STATE yy_scan_bytes(const char*, int, yyscan_t);
+extern "C" YY_BUFFER_STATE yy_scan_buffer(char*, size_t, yyscan_t);
 extern "C" void yy_delete_buffer(YY_BUFFER_STATE, yyscan_t);
 
 #else
@@ -38,12 +82,11 @@ extern "C" void yy_delete_buffer(YY_BUFFER_STATE, yyscan_t);
 /// Flex stuff (non-reentrant)
 typedef void *YY_BUFFER_STATE;
 extern FILE *yyin;
-extern const char *yytext;
-extern size_t yyleng;
+extern char *yytext;
+extern int yyleng;
 extern int yylineno;
 extern "C" int yylex();
-extern "C" YY_BUFFER_STATE yy_scan_string(const char*);
-extern "C" YY_BUFFER_STATE yy_scan_bytes(const char*, int);
+extern "C" YY_BUFFER_STATE yy_scan_buffer(char*, size_t);
 extern "C" void yy_delete_buffer(YY_BUFFER_STATE);
 
 #endif
@@ -51,119 +94,212 @@ extern "C" void yy_delete_buffer(YY_BUFFER_STATE);
 class FlexTokenizer : public Tokenizer
 {
   public:
-    FlexTokenizer(FILE *fd = stdin) : fd_(fd), eof_(false)
+    /// selects the constructor that maps a file into memory
+    enum Mapped { MAPPED };
+    /// scan a file on demand
+    FlexTokenizer(FILE *fd = stdin) : FlexTokenizer(INIT)
     {
-#ifdef FLEX_REENTRANT
-      yylex_init(&yyscanner);
-      yyset_in(fd_, yyscanner);
+#ifndef FLEX_NONREENTRANT
+      yyset_in(fd, scanner_);
 #else
-      yyin = fd_;
+      yyin = fd;
 #endif
-      clear();
+      eof_ = false;
     }
-    FlexTokenizer(const char *s) : fd_(NULL)
+    /// scan a 0-terminated string
+    FlexTokenizer(const char *s) : FlexTokenizer(INIT)
     {
-#ifdef FLEX_REENTRANT
-      yylex_init(&yyscanner);
-      YY_BUFFER_STATE buffer = yy_scan_string(s, yyscanner);
-#else
-      YY_BUFFER_STATE buffer = yy_scan_string(s);
-#endif
-      clear();
-      while (true)
-      {
-        int code;
-#ifdef FLEX_REENTRANT
-        code = yylex(yyscanner);
-#else
-        code = yylex();
-#endif
-        if (code <= 0)
-          break;
-#ifdef FLEX_REENTRANT
-        emplace_back(code, yyget_text(yyscanner), yyget_leng(yyscanner), yyget_lineno(yyscanner), 0);
-#else
-        emplace_back(code, yytext, yyleng, yylineno, 0);
-#endif
-      }
-#ifdef FLEX_REENTRANT
-      yy_delete_buffer(buffer, yyscanner);
-      yylex_destroy(yyscanner);
-#else
-      yy_delete_buffer(buffer);
-#endif
+      scan(s, strlen(s));
     }
-    FlexTokenizer(const std::string& s) : fd_(NULL), eof_(false)
+    /// scan a string
+    FlexTokenizer(const std::string& s) : FlexTokenizer(INIT)
     {
-#ifdef FLEX_REENTRANT
-      yylex_init(&yyscanner);
-      YY_BUFFER_STATE buffer = yy_scan_bytes(s.c_str(), (int)s.size(), yyscanner);
-#else
-      YY_BUFFER_STATE buffer = yy_scan_bytes(s.c_str(), (int)s.size());
-#endif
-      clear();
-      while (true)
+      scan(s.data(), s.size());
+    }
+    /// scan a file mapped into memory on demand
+    FlexTokenizer(const char *path, Mapped) : FlexTokenizer(INIT)
+    {
+      int fd = open(path, O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error(std::string("FlexTokenizer: cannot open ") + path);
+      struct stat st;
+      if (fstat(fd, &st) < 0)
       {
-        int code;
-#ifdef FLEX_REENTRANT
-        code = yylex(yyscanner);
-#else
-        code = yylex();
-#endif
-        if (code <= 0)
-          break;
-#ifdef FLEX_REENTRANT
-        emplace_back(code, yyget_text(yyscanner), yyget_leng(yyscanner), yyget_lineno(yyscanner), 0);
-#else
-        emplace_back(code, yytext, yyleng, yylineno, 0);
-#endif
+        close(fd);
+        throw std::runtime_error(std::string("FlexTokenizer: cannot stat ") + path);
       }
-#ifdef FLEX_REENTRANT
-      yy_delete_buffer(buffer, yyscanner);
-      yylex_destroy(yyscanner);
-#else
-      yy_delete_buffer(buffer);
+      // reserve zeroed pages for the file and the two 0 bytes that end a flex buffer, then map the file over them,
+      // writable and private since the scanner writes a 0 byte after each lexeme
+      size_t size = static_cast<size_t>(st.st_size);
+      size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      map_size_ = (size + 2 + page - 1) / page * page;
+      void *map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (map != MAP_FAILED && size > 0 && mmap(map, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+      {
+        munmap(map, map_size_);
+        map = MAP_FAILED;
+      }
+      close(fd);
+      if (map == MAP_FAILED)
+        throw std::runtime_error(std::string("FlexTokenizer: cannot map ") + path);
+      map_ = static_cast<char*>(map);
+      madvise(map_, size, MADV_SEQUENTIAL);
+      start(map_, size);
+      eof_ = false;
+    }
+    FlexTokenizer(const FlexTokenizer&) = delete;
+    FlexTokenizer& operator=(const FlexTokenizer&) = delete;
+    virtual ~FlexTokenizer()
+    {
+      stop();
+#ifndef FLEX_NONREENTRANT
+      yylex_destroy(scanner_);
 #endif
+      if (map_)
+        munmap(map_, map_size_);
     }
     virtual bool has_pos(size_t pos)
     {
-      if (fd_ && !eof_)
+      if (!eof_)
         fill_to(pos);
-      return pos < size();
+      return Tokenizer::has_pos(pos);
     }
-    virtual const Token& at(size_t pos)
+    virtual Token at(size_t pos)
     {
-      if (fd_ && !eof_)
+      if (!eof_)
         fill_to(pos);
       return Tokenizer::at(pos);
     }
   private:
+    enum Init { INIT };
+    // construct with a scanner, delegated to by the public constructors, so that the destructor releases the scanner when they throw
+    explicit FlexTokenizer(Init)
+      :
+        eof_(true),
+        map_(NULL),
+        map_size_(0),
+        buffer_(NULL),
+        scanned_(NULL),
+        lineno_(1),
+        columno_(0)
+    {
+#ifndef FLEX_NONREENTRANT
+      if (yylex_init(&scanner_) != 0)
+        throw std::runtime_error("FlexTokenizer: cannot create scanner");
+#endif
+    }
+    // scan a copy of the text, which ends with the two 0 bytes of a flex buffer
+    void scan(const char *text, size_t size)
+    {
+      copy_.reset(new char[size + 2]);
+      memcpy(copy_.get(), text, size);
+      copy_[size] = copy_[size + 1] = '\0';
+      start(copy_.get(), size);
+      fill_to(~static_cast<size_t>(0) - 1);
+      stop();
+      copy_.reset();
+    }
+    // start scanning the text in place, which ends with the two 0 bytes of a flex buffer
+    void start(char *text, size_t size)
+    {
+#ifndef FLEX_NONREENTRANT
+      buffer_ = yy_scan_buffer(text, size + 2, scanner_);
+#else
+      buffer_ = yy_scan_buffer(text, size + 2);
+#endif
+      if (buffer_ == NULL)
+        throw std::runtime_error("FlexTokenizer: cannot scan buffer");
+      scanned_ = text;
+    }
+    // stop scanning the text
+    void stop()
+    {
+      if (buffer_)
+      {
+#ifndef FLEX_NONREENTRANT
+        yy_delete_buffer(buffer_, scanner_);
+#else
+        yy_delete_buffer(buffer_);
+#endif
+        buffer_ = NULL;
+      }
+      scanned_ = NULL;
+    }
     void fill_to(size_t pos)
     {
       while (pos >= size())
       {
-        int code;
-#ifdef FLEX_REENTRANT
-        code = yylex(yyscanner);
+#ifndef FLEX_NONREENTRANT
+        int code = yylex(scanner_);
+        const char *text = yyget_text(scanner_);
+        size_t leng = yyget_leng(scanner_);
 #else
-        code = yylex();
+        int code = yylex();
+        const char *text = yytext;
+        size_t leng = yyleng;
 #endif
         if (code <= 0)
         {
           eof_ = true;
           break;
         }
-#ifdef FLEX_REENTRANT
-        emplace_back(code, yyget_text(yyscanner), yyget_leng(yyscanner), yyget_lineno(yyscanner), 0);
+        size_t lineno, columno;
+        locate(text, leng, lineno, columno);
+        // the lexemes of a mapped file remain in the mapping, since the scanner restores the byte after a lexeme
+        if (map_)
+          emplace_view(code, text, leng, lineno, columno);
+        else
+          emplace_back(code, text, leng, lineno, columno);
+      }
+    }
+    // returns the line and column of the lexeme text
+    void locate(const char *text, size_t leng, size_t& lineno, size_t& columno)
+    {
+      if (scanned_ == NULL)
+      {
+        // a FILE* is scanned in a buffer that is refilled, so the scanner counts lines and columns
+#ifndef FLEX_NONREENTRANT
+        lineno = yyget_lineno(scanner_);
+        columno = yyget_column(scanner_);
 #else
-        emplace_back(code, yytext, yyleng, yylineno, 0);
+        lineno = yylineno;
+        columno = 0;
 #endif
+        // with %option yylineno, the scanner counts the newlines of the lexeme before its action returns
+        for (size_t i = 0; i < leng; ++i)
+          if (text[i] == '\n' && lineno > 1)
+            --lineno;
+        return;
       }
+      advance(text);
+      lineno = lineno_;
+      columno = columno_;
+      advance(text + leng);
     }
-    FILE *fd_;
-    bool eof_;
-#ifdef FLEX_REENTRANT
-    yyscan_t yyscanner;
+    // count the lines and columns of the text scanned up to end
+    void advance(const char *end)
+    {
+      const char *s;
+      while ((s = static_cast<const char*>(memchr(scanned_, '\n', end - scanned_))) != NULL)
+      {
+        ++lineno_;
+        columno_ = 0;
+        scanned_ = s + 1;
+      }
+      columno_ += end - scanned_;
+      scanned_ = end;
+    }
+
+    bool                    eof_;      // all tokens are scanned
+    char                   *map_;      // mapping of a file scanned on demand, or NULL
+    size_t                  map_size_; // size of the mapping
+    std::unique_ptr<char[]> copy_;     // copy of a string being scanned
+    YY_BUFFER_STATE         buffer_;   // flex buffer of the text scanned in place, or NULL
+    const char             *scanned_;  // end of the text of which lines and columns are counted, NULL for a FILE*
+    size_t                  lineno_;   // line number at scanned_
+    size_t                  columno_;  // column number at scanned_
+#ifndef FLEX_NONREENTRANT
+    yyscan_t                scanner_;  // scanner owned by this FlexTokenizer
 #endif
 };
 
@@ -0,0 +1,64 @@
+//      grammar.h
+//
+//      Grammar class owns the memory of the nodes of a grammar
+//
+//      Grammar g;                          // declare before the parsers of the grammar
+//      Parser<int> expr, term, fact;
+//      {
+//        Grammar::Build build(g);          // nodes built by this thread come from g
+//        expr>>a = term>>a & *( '+' & term>>b & [&]{ a += b; } );
+//        ...
+//      }
+//
+//      The operators of a rule create a node for each operator, owned by the
+//      parsers of the rule.  While a Build is in effect, the nodes and their
+//      arrays of arguments are allocated from the arena of the Grammar, so
+//      building a rule costs a pointer increment per node, and destroying the
+//      parsers frees no nodes one by one: the memory of the grammar is
+//      released at once when the Grammar is destroyed, which must thus
+//      outlive its parsers.  Parsers declared while a Build is in effect also
+//      allocate their arrays from the Grammar.
+//
+//      A grammar that is instantiated many times, e.g. per tenant or per
+//      thread, gets a Grammar for each instance.
+
+#ifndef GRAMMARS
+#define GRAMMARS
+
+#include "memoryresource.h"
+
+class Grammar
+{
+  public:
+    /// makes the arena of a grammar the current MemoryResource of its thread for the lifetime of a Build
+    class Build : public MemoryResource::Use
+    {
+      public:
+        explicit Build(Grammar& grammar)
+          :
+            MemoryResource::Use(&grammar.arena_)
+        { }
+    };
+
+    explicit Grammar(size_t block = 65536, MemoryResource *upstream = MemoryResource::standard())
+      :
+        arena_(block, upstream)
+    { }
+    Grammar(const Grammar&) = delete;
+    Grammar& operator=(const Grammar&) = delete;
+    /// returns the resource of the nodes of the grammar
+    MemoryResource *resource()
+    {
+      return &arena_;
+    }
+    /// returns the number of bytes allocated for the grammar
+    size_t size() const
+    {
+      return arena_.size();
+    }
+
+  protected:
+    Arena arena_; // memory of the nodes
+};
+
+#endif
@@ -0,0 +1,440 @@
+//      memoryresource.h
+//
+//      MemoryResource class is a source of memory for grammars, tokens and parse trees
+//
+//      Arena arena;                       // memory released all at once
+//      Accounting acct(&arena);           // counts the allocations from the arena
+//      {
+//        MemoryResource::Use use(acct.memory(Accounting::GRAMMAR));
+//        start = ...;                     // grammar nodes come from acct
+//      }
+//      MemoryResource::Use use(acct.memory(Accounting::TOKENS));
+//      FlexTokenizer tokens(input);       // tokens and lexemes come from acct
+//      ParseTree tree(acct.memory(Accounting::TREE));
+//      start.parse(&tokens, &pos, &tree);
+//      acct.report(std::cout);            // allocations and bytes by category
+//
+//      A MemoryResource has the interface of std::pmr::memory_resource, and
+//      is a std::pmr::memory_resource when compiled with C++17 or later, so
+//      an Arena or Accounting also serves std::pmr containers.  PmrResource
+//      adapts a std::pmr::memory_resource, e.g. a monotonic_buffer_resource.
+//
+//      The nodes of grammars, the TokenSets of their terminals, the tokens
+//      and lexemes of a Tokenizer, and the nodes of a ParseTree are allocated
+//      from the current resource of the thread when they are created, which
+//      is the standard resource of operator new unless a Use says otherwise.
+//      Tokenizer and ParseTree also take a resource when constructed.  A
+//      resource must outlive the grammars, tokens and trees allocated from
+//      it.  Memoized results and Context state use the standard allocator.
+//
+//      An Arena never releases its memory until it is released or destroyed,
+//      so allocations are a pointer increment and releasing a grammar or the
+//      tokens and tree of a parse costs nothing.
+
+#ifndef MEMORYRESOURCE
+#define MEMORYRESOURCE
+
+#include <algorithm> // std::max()
+#include <cstddef>   // std::max_align_t
+#include <cstdint>   // uintptr_t
+#include <iomanip>   // std::setw()
+#include <iostream>
+#include <limits>
+#include <new>       // std::bad_alloc
+#include <type_traits>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#define MEMORYRESOURCE_PMR
+#endif
+
+#ifdef MEMORYRESOURCE_PMR
+class MemoryResource : public std::pmr::memory_resource
+#else
+class MemoryResource
+#endif
+{
+  public:
+#ifdef MEMORYRESOURCE_PMR
+    typedef std::pmr::memory_resource Base;
+#else
+    typedef MemoryResource Base;
+#endif
+    static const size_t ALIGN = alignof(std::max_align_t); // default alignment
+
+    /// makes a resource the current resource of its thread for the lifetime of a Use
+    class Use
+    {
+      public:
+        explicit Use(MemoryResource *memory)
+          :
+            prev_(thread())
+        {
+          thread() = memory;
+        }
+        ~Use()
+        {
+          thread() = prev_;
+        }
+      protected:
+        MemoryResource *prev_;
+    };
+
+    virtual ~MemoryResource()
+    { }
+#ifndef MEMORYRESOURCE_PMR
+    /// allocate bytes aligned to align, throws std::bad_alloc
+    void *allocate(size_t bytes, size_t align = ALIGN)
+    {
+      return do_allocate(bytes, align);
+    }
+    /// release bytes allocated with the same size and alignment
+    void deallocate(void *p, size_t bytes, size_t align = ALIGN)
+    {
+      do_deallocate(p, bytes, align);
+    }
+    /// returns true if memory allocated from this resource can be released by other
+    bool is_equal(const Base& other) const noexcept
+    {
+      return do_is_equal(other);
+    }
+#endif
+    /// returns the resource of operator new and operator delete
+    static MemoryResource *standard();
+    /// returns the current resource of this thread, standard() when no Use is in effect
+    static MemoryResource *current()
+    {
+      return thread();
+    }
+
+  protected:
+
+    // the resource of operator new and operator delete
+    class Standard;
+
+    // returns the current resource of this thread
+    static MemoryResource*& thread()
+    {
+      static thread_local MemoryResource *memory = standard();
+      return memory;
+    }
+
+    virtual void *do_allocate(size_t bytes, size_t align) = 0;
+    virtual void do_deallocate(void *p, size_t bytes, size_t align) = 0;
+    virtual bool do_is_equal(const Base& other) const noexcept = 0;
+};
+
+class MemoryResource::Standard : public MemoryResource
+{
+  protected:
+    void *do_allocate(size_t bytes, size_t align)
+    {
+      // operator new only aligns to max_align_t before C++17
+      if (align > ALIGN)
+        throw std::bad_alloc();
+      return ::operator new(bytes);
+    }
+    void do_deallocate(void *p, size_t, size_t)
+    {
+      ::operator delete(p);
+    }
+    bool do_is_equal(const Base& other) const noexcept
+    {
+      return this == &other;
+    }
+};
+
+inline MemoryResource *MemoryResource::standard()
+{
+  static Standard memory;
+  return &memory;
+}
+
+/// allocator of containers that allocate from a MemoryResource, as std::pmr::polymorphic_allocator
+/// except that a container moved or swapped takes its allocator along, so nodes can exchange their arrays
+template<typename T>
+class Allocator
+{
+  template<typename> friend class Allocator;
+
+  public:
+    typedef T              value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Allocator(MemoryResource *memory = MemoryResource::current()) noexcept
+      :
+        memory_(memory)
+    { }
+    template<typename U>
+    Allocator(const Allocator<U>& other) noexcept
+      :
+        memory_(other.memory_)
+    { }
+    T *allocate(size_t n)
+    {
+      if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+        throw std::bad_alloc();
+      return static_cast<T*>(memory_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, size_t n)
+    {
+      memory_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+    /// returns the resource of the allocator
+    MemoryResource *resource() const
+    {
+      return memory_;
+    }
+    template<typename U>
+    bool operator==(const Allocator<U>& other) const
+    {
+      return memory_ == other.memory_ || memory_->is_equal(*other.memory_);
+    }
+    template<typename U>
+    bool operator!=(const Allocator<U>& other) const
+    {
+      return !(*this == other);
+    }
+
+  protected:
+    MemoryResource *memory_; // resource to allocate from
+};
+
+/// monotonic resource, releases its memory all at once when released or destroyed
+class Arena : public MemoryResource
+{
+  public:
+    explicit Arena(size_t block = 4096, MemoryResource *upstream = MemoryResource::standard())
+      :
+        upstream_(upstream),
+        block_(std::max(block, static_cast<size_t>(64))),
+        next_(NULL),
+        left_(0),
+        size_(0)
+    { }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena()
+    {
+      release();
+    }
+    /// release all memory allocated from the arena
+    void release()
+    {
+      for (auto& b : blocks_)
+        upstream_->deallocate(b.data, b.size, ALIGN);
+      blocks_.clear();
+      next_ = NULL;
+      left_ = 0;
+      size_ = 0;
+    }
+    /// returns the number of bytes the arena obtained from its upstream resource
+    size_t size() const
+    {
+      return size_;
+    }
+
+  protected:
+
+    // memory obtained from the upstream resource
+    struct Block
+    {
+      char   *data; // bytes
+      size_t  size; // number of bytes
+    };
+
+    void *do_allocate(size_t bytes, size_t align)
+    {
+      size_t skip = (align - reinterpret_cast<uintptr_t>(next_) % align) % align;
+      if (next_ == NULL || skip + bytes > left_)
+      {
+        // blocks double in size, a large allocation gets a block of its own
+        size_t size = std::max(bytes + align, blocks_.empty() ? block_ : 2 * blocks_.back().size);
+        Block b = { static_cast<char*>(upstream_->allocate(size, ALIGN)), size };
+        blocks_.push_back(b);
+        size_ += size;
+        next_ = b.data;
+        left_ = size;
+        skip = (align - reinterpret_cast<uintptr_t>(next_) % align) % align;
+      }
+      void *p = next_ + skip;
+      next_ += skip + bytes;
+      left_ -= skip + bytes;
+      return p;
+    }
+    void do_deallocate(void*, size_t, size_t)
+    { }
+    bool do_is_equal(const Base& other) const noexcept
+    {
+      return this == &other;
+    }
+
+    MemoryResource     *upstream_; // resource of the blocks
+    size_t              block_;    // size of the first block
+    std::vector<Block>  blocks_;   // blocks, the current block is the last
+    char               *next_;     // next free byte of the current block
+    size_t              left_;     // number of free bytes of the current block
+    size_t              size_;     // number of bytes of the blocks
+};
+
+/// counts the allocations and bytes of grammars, tokens and trees allocated from an upstream resource
+class Accounting
+{
+  public:
+    /// what memory is allocated for
+    enum Category { GRAMMAR, TOKENS, TREE, OTHER, CATEGORIES };
+    /// counts of a category
+    struct Counters
+    {
+      Counters()
+        :
+          allocations(0),
+          deallocations(0),
+          bytes(0),
+          live(0),
+          peak(0)
+      { }
+      size_t allocations;   ///< number of allocations
+      size_t deallocations; ///< number of deallocations
+      size_t bytes;         ///< number of bytes allocated
+      size_t live;          ///< number of bytes allocated and not deallocated
+      size_t peak;          ///< max number of live bytes
+    };
+
+    explicit Accounting(MemoryResource *upstream = MemoryResource::standard())
+    {
+      for (int c = 0; c < CATEGORIES; ++c)
+      {
+        counted_[c].upstream = upstream;
+        counted_[c].total = &total_;
+      }
+    }
+    Accounting(const Accounting&) = delete;
+    Accounting& operator=(const Accounting&) = delete;
+    /// returns the resource that counts its allocations in category c
+    MemoryResource *memory(Category c)
+    {
+      return &counted_[c];
+    }
+    /// returns the counts of category c
+    const Counters& counters(Category c) const
+    {
+      return counted_[c].counters;
+    }
+    /// returns the counts of all categories
+    const Counters& total() const
+    {
+      return total_;
+    }
+    /// reset the counts to zero, keeping the live bytes
+    void reset()
+    {
+      for (int c = 0; c < CATEGORIES; ++c)
+        reset(counted_[c].counters);
+      reset(total_);
+    }
+    /// print a table of the counts by category
+    void report(std::ostream& os) const
+    {
+      static const char *names[] = { "grammar", "tokens", "tree", "other" };
+      os << std::left << std::setw(10) << "category" << std::right
+         << std::setw(14) << "allocations"
+         << std::setw(14) << "deallocations"
+         << std::setw(14) << "bytes"
+         << std::setw(14) << "live"
+         << std::setw(14) << "peak" << "\n";
+      for (int c = 0; c <= CATEGORIES; ++c)
+      {
+        const Counters& n = c < CATEGORIES ? counted_[c].counters : total_;
+        os << std::left << std::setw(10) << (c < CATEGORIES ? names[c] : "total") << std::right
+           << std::setw(14) << n.allocations
+           << std::setw(14) << n.deallocations
+           << std::setw(14) << n.bytes
+           << std::setw(14) << n.live
+           << std::setw(14) << n.peak << "\n";
+      }
+    }
+
+  protected:
+
+    // resource of a category, counts its allocations and those of all categories
+    class Counted : public MemoryResource
+    {
+      public:
+        MemoryResource *upstream; // resource to allocate from
+        Counters        counters; // counts of the category
+        Counters       *total;    // counts of all categories
+      protected:
+        void *do_allocate(size_t bytes, size_t align)
+        {
+          void *p = upstream->allocate(bytes, align);
+          count(counters, bytes);
+          count(*total, bytes);
+          return p;
+        }
+        void do_deallocate(void *p, size_t bytes, size_t align)
+        {
+          upstream->deallocate(p, bytes, align);
+          uncount(counters, bytes);
+          uncount(*total, bytes);
+        }
+        bool do_is_equal(const Base& other) const noexcept
+        {
+          return this == &other;
+        }
+        static void count(Counters& n, size_t bytes)
+        {
+          ++n.allocations;
+          n.bytes += bytes;
+          n.live += bytes;
+          n.peak = std::max(n.peak, n.live);
+        }
+        static void uncount(Counters& n, size_t bytes)
+        {
+          ++n.deallocations;
+          n.live -= bytes;
+        }
+    };
+
+    static void reset(Counters& n)
+    {
+      n.allocations = 0;
+      n.deallocations = 0;
+      n.bytes = 0;
+      n.peak = n.live;
+    }
+
+    Counted  counted_[CATEGORIES]; // resources of the categories
+    Counters total_;               // counts of all categories
+};
+
+#ifdef MEMORYRESOURCE_PMR
+/// resource that allocates from a std::pmr::memory_resource
+class PmrResource : public MemoryResource
+{
+  public:
+    explicit PmrResource(std::pmr::memory_resource *upstream)
+      :
+        upstream_(upstream)
+    { }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t align)
+    {
+      return upstream_->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align)
+    {
+      upstream_->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const Base& other) const noexcept
+    {
+      return this == &other || upstream_->is_equal(other);
+    }
+
+    std::pmr::memory_resource *upstream_; // resource to allocate from
+};
+#endif
+
+#endif
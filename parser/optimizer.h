@@ -0,0 +1,408 @@
+//      optimizer.h
+//
+//      Rewrites a grammar into an equivalent grammar that parses faster
+//
+//      Optimizer opt(&start);            // optimize the grammar of nonterminal start
+//      opt.optimize();                   // rewrites that keep parse trees the same
+//      opt.optimize(Optimizer::ALL);     // also inline small definitions
+//
+//      The operator overloads build sequences and alternations nested in the
+//      order in which the grammar is written, and alternatives that start
+//      with the same node parse that node again after each backtrack.  The
+//      optimizer rewrites the nodes of the grammar in place:
+//
+//      FLATTEN    (X & Y) & Z  ->  X & Y & Z,  (X | Y) | Z  ->  X | Y | Z,
+//                 and a sequence or alternation of one node is that node
+//      FACTOR     X & Y | X & Z  ->  X & (Y | Z),  when X has no actions and
+//                 no flow variables, so that parsing X again at the same
+//                 position gives the same result without side effects
+//      LOOKAHEAD  !X & Y  ->  Y,  when Y cannot start with a token that X
+//                 starts with, Y is not nullable, and neither X nor Y has
+//                 side effects before Y fails on such a token
+//      TOKENS     'a' | 'b' | 'c'  ->  Token({'a','b','c'}),  alternatives that
+//                 are tokens without flow variables are matched with one
+//                 lookup in a TokenSet
+//      INLINE     replaces calls of small definitions without actions and
+//                 flow variables that are not recursive or memoized by their
+//                 bodies
+//
+//      All rewrites keep the language accepted, the actions executed and the
+//      values of flow variables.  INLINE removes the nodes of the inlined
+//      definitions from parse trees, so it is not part of the default SAFE
+//      rewrites.
+//
+//      Optimize the grammar after it is complete, and before indexing it with
+//      Analysis::index(), compiling a Program for it or freezing it.
+
+#ifndef OPTIMIZER
+#define OPTIMIZER
+
+#include <cassert>
+#include <map>
+#include <set>
+#include <vector>
+#include "parser.h"
+#include "analysis.h"
+
+class Optimizer
+{
+  public:
+    /// rewrites, see above
+    enum Pass
+    {
+      FLATTEN   = 1,
+      FACTOR    = 2,
+      LOOKAHEAD = 4,
+      INLINE    = 8,
+      TOKENS    = 16,
+      SAFE      = FLATTEN | FACTOR | LOOKAHEAD | TOKENS, ///< rewrites that keep parse trees the same
+      ALL       = SAFE | INLINE
+    };
+    static const size_t SMALL = 8; ///< max number of nodes of an inlined definition
+
+    explicit Optimizer(BaseParser *start)
+      :
+        start_(start)
+    {
+      assert(start->tag_ == BaseParser::Tag::DEF);
+    }
+    /// rewrite the grammar until no rewrite applies, returns the number of rewrites
+    size_t optimize(unsigned passes = SAFE)
+    {
+      size_t count = 0;
+      while (true)
+      {
+        size_t n = pass(passes);
+        if (n == 0)
+          return count;
+        count += n;
+      }
+    }
+
+  protected:
+
+    typedef BaseParser::Tag Tag;
+
+    // rewrite each node of the grammar once, returns the number of rewrites
+    size_t pass(unsigned passes)
+    {
+      nodes_.clear();
+      pure_.clear();
+      recursive_.clear();
+      bodies_.clear();
+      std::set<BaseParser*> seen;
+      visit(start_, seen);
+      Analysis an(start_);
+      size_t n = 0;
+      for (auto p : nodes_)
+      {
+        size_t m = n;
+        if (passes & INLINE)
+          n += inline_defs(p);
+        if (passes & FLATTEN)
+          n += flatten(p);
+        if ((passes & LOOKAHEAD) && p->tag_ == Tag::SEQ)
+          n += lookahead(p, an);
+        if ((passes & TOKENS) && (p->tag_ == Tag::ALT || p->tag_ == Tag::DEF))
+          n += tokens(p);
+        if ((passes & FACTOR) && (p->tag_ == Tag::ALT || p->tag_ == Tag::DEF))
+          n += factor(p);
+        if (n > m)
+          p->idx_.reset(); // the index of an alternation no longer matches its alternatives
+      }
+      return n;
+    }
+    // collect the nodes reachable from arg
+    void visit(BaseParser *arg, std::set<BaseParser*>& seen)
+    {
+      if (!seen.insert(arg).second)
+        return;
+      nodes_.push_back(arg);
+      if (arg->tag_ == Tag::NON)
+        visit(const_cast<BaseParser*>(arg->get_def()), seen); // a NON's def is never const
+      for (auto a : arg->arg_)
+        visit(a, seen);
+    }
+
+    // FLATTEN: splice sequences into sequences and alternations into alternations and definitions
+    size_t flatten(BaseParser *p)
+    {
+      size_t n = 0;
+      std::vector<BaseParser*> args;
+      for (auto a : p->arg_)
+      {
+        while (plain(a) && a->arg_.size() == 1)
+        {
+          a = a->arg_[0];
+          ++n;
+        }
+        if (plain(a) && a->tag_ == (p->tag_ == Tag::SEQ ? Tag::SEQ : Tag::ALT))
+        {
+          args.insert(args.end(), a->arg_.begin(), a->arg_.end());
+          ++n;
+        }
+        else
+        {
+          args.push_back(a);
+        }
+      }
+      if (n > 0)
+        p->arg_.assign(args.begin(), args.end());
+      return n;
+    }
+
+    // FACTOR: factor the first node shared by consecutive alternatives of an alternation or definition
+    size_t factor(BaseParser *p)
+    {
+      size_t n = 0;
+      BaseParser::Nodes& alts = p->arg_;
+      std::vector<BaseParser*> args;
+      for (size_t i = 0; i < alts.size(); )
+      {
+        BaseParser *h = head(alts[i]);
+        size_t j = i + 1;
+        if (pure(h))
+          while (j < alts.size() && same(head(alts[j]), h))
+            ++j;
+        if (j - i > 1)
+        {
+          // X & Y | X & Z -> X & (Y | Z)
+          BaseParser *alt = make(p, Tag::ALT);
+          for (size_t k = i; k < j; ++k)
+            alt->arg_.push_back(rest(p, alts[k]));
+          BaseParser *seq = make(p, Tag::SEQ);
+          seq->arg_.push_back(h);
+          seq->arg_.push_back(alt);
+          args.push_back(seq);
+          ++n;
+        }
+        else
+        {
+          args.push_back(alts[i]);
+        }
+        i = j;
+      }
+      if (n > 0)
+        alts.assign(args.begin(), args.end());
+      return n;
+    }
+    // returns the first node of an alternative
+    static BaseParser *head(BaseParser *alt)
+    {
+      if (plain(alt) && alt->tag_ == Tag::SEQ && !alt->arg_.empty())
+        return alt->arg_[0];
+      return alt;
+    }
+    // returns the nodes of an alternative after its head, as a new node of p
+    BaseParser *rest(BaseParser *p, BaseParser *alt)
+    {
+      if (head(alt) == alt)
+        return make(p, Tag::SEQ); // empty sequence
+      if (alt->arg_.size() == 2)
+        return alt->arg_[1];
+      BaseParser *seq = make(p, Tag::SEQ);
+      seq->arg_.assign(alt->arg_.begin() + 1, alt->arg_.end());
+      return seq;
+    }
+    // returns true if x and y parse the same
+    static bool same(const BaseParser *x, const BaseParser *y)
+    {
+      if (x == y)
+        return true;
+      if (!token(x) || !token(y))
+        return false;
+      if (x->set_ || y->set_)
+        return x->set_ && y->set_ && x->set_->codes() == y->set_->codes();
+      return x->tok_code == y->tok_code;
+    }
+    // returns true if arg is a token or token set without flow variables
+    static bool token(const BaseParser *arg)
+    {
+      return arg->tag_ == Tag::TOK && !arg->get_in() && !arg->get_out();
+    }
+
+    // TOKENS: merge consecutive alternatives of an alternation or definition that are tokens into a token set
+    size_t tokens(BaseParser *p)
+    {
+      size_t n = 0;
+      BaseParser::Nodes& alts = p->arg_;
+      std::vector<BaseParser*> args;
+      for (size_t i = 0; i < alts.size(); )
+      {
+        std::vector<int> codes;
+        size_t j = i;
+        for (; j < alts.size() && token(alts[j]); ++j)
+        {
+          if (alts[j]->set_)
+            codes.insert(codes.end(), alts[j]->set_->codes().begin(), alts[j]->set_->codes().end());
+          else
+            codes.push_back(alts[j]->tok_code);
+        }
+        if (j - i > 1)
+        {
+          // 'a' | 'b' -> Token({'a','b'})
+          BaseParser *tok = make(p, Tag::TOK);
+          tok->tok_code = codes.front();
+          tok->set_ = std::allocate_shared<TokenSet>(Allocator<TokenSet>(), codes.begin(), codes.end());
+          args.push_back(tok);
+          ++n;
+          i = j;
+        }
+        else
+        {
+          args.push_back(alts[i++]);
+        }
+      }
+      if (n > 0)
+        alts.assign(args.begin(), args.end());
+      return n;
+    }
+
+    // LOOKAHEAD: remove negative lookaheads !X of a sequence that the node after them checks anyway
+    size_t lookahead(BaseParser *p, const Analysis& an)
+    {
+      size_t n = 0;
+      std::vector<BaseParser*> args;
+      for (size_t k = 0; k < p->arg_.size(); ++k)
+      {
+        BaseParser *a = p->arg_[k];
+        if (k + 1 < p->arg_.size() && a->max_ == 0 && a->min_ == 0 && pure(a))
+        {
+          // FIRST set of the body of !X
+          Analysis::First x = a->tag_ == Tag::SEQ ? an.sequence(a->arg_) : an.alternation(a->arg_);
+          Analysis::First y = an.first(p->arg_[k + 1]);
+          bool disjoint = true;
+          for (auto c : x.codes)
+            if (y.codes.count(c))
+              disjoint = false;
+          if (disjoint && !x.nullable && !y.nullable && !y.opaque)
+          {
+            ++n;
+            continue;
+          }
+        }
+        args.push_back(a);
+      }
+      if (n > 0)
+        p->arg_.assign(args.begin(), args.end());
+      return n;
+    }
+    // INLINE: replace the calls of small definitions by their bodies
+    size_t inline_defs(BaseParser *p)
+    {
+      size_t n = 0;
+      for (auto& a : p->arg_)
+      {
+        if (inlinable(a))
+        {
+          a = body(a);
+          ++n;
+        }
+      }
+      return n;
+    }
+    bool inlinable(BaseParser *def)
+    {
+      if (def->tag_ != Tag::DEF || def == start_ || def->arg_.empty())
+        return false;
+      if (def->get_in() || def->get_out() || def->get_memo() > 0 || def->min_ != 1 || def->max_ != 1)
+        return false;
+      size_t size = 0;
+      for (auto a : def->arg_)
+        if (!local(a, size))
+          return false;
+      return !recursive(def);
+    }
+    // add the number of nodes of arg up to calls to size, returns false when arg has actions or flow variables or is too large
+    static bool local(const BaseParser *arg, size_t& size)
+    {
+      if (++size > SMALL || arg->tag_ == Tag::ACT || arg->tag_ == Tag::NON || arg->get_in() || arg->get_out())
+        return false;
+      if (arg->tag_ == Tag::DEF)
+        return true;
+      for (auto a : arg->arg_)
+        if (!local(a, size))
+          return false;
+      return true;
+    }
+    // returns the body of a definition, its alternative or an alternation of its alternatives
+    BaseParser *body(BaseParser *def)
+    {
+      if (def->arg_.size() == 1)
+        return def->arg_[0];
+      BaseParser *&alt = bodies_[def];
+      if (alt == NULL)
+      {
+        alt = make(def, Tag::ALT);
+        alt->arg_ = def->arg_;
+      }
+      return alt;
+    }
+    // returns true if the definition can call itself
+    bool recursive(const BaseParser *def)
+    {
+      auto r = recursive_.find(def);
+      if (r != recursive_.end())
+        return r->second;
+      std::set<const BaseParser*> seen;
+      std::vector<const BaseParser*> todo(def->arg_.begin(), def->arg_.end());
+      bool found = false;
+      while (!todo.empty() && !found)
+      {
+        const BaseParser *a = todo.back();
+        todo.pop_back();
+        if (a->tag_ == Tag::NON)
+          a = a->get_def();
+        if (a == def)
+          found = true;
+        else if (seen.insert(a).second)
+          todo.insert(todo.end(), a->arg_.begin(), a->arg_.end());
+      }
+      recursive_[def] = found;
+      return found;
+    }
+
+    // returns true if arg and the definitions it calls have no actions and no flow variables
+    bool pure(const BaseParser *arg)
+    {
+      auto r = pure_.find(arg);
+      if (r != pure_.end())
+        return r->second;
+      std::set<const BaseParser*> seen;
+      std::vector<const BaseParser*> todo(1, arg);
+      bool ok = true;
+      while (!todo.empty() && ok)
+      {
+        const BaseParser *a = todo.back();
+        todo.pop_back();
+        if (!seen.insert(a).second)
+          continue;
+        if (a->tag_ == Tag::ACT || a->tag_ == Tag::NON || a->get_in() || a->get_out())
+          ok = false;
+        todo.insert(todo.end(), a->arg_.begin(), a->arg_.end());
+      }
+      pure_[arg] = ok;
+      return ok;
+    }
+
+    // returns true if arg is a sequence or alternation without repeats or lookahead
+    static bool plain(const BaseParser *arg)
+    {
+      return (arg->tag_ == Tag::SEQ || arg->tag_ == Tag::ALT) && arg->min_ == 1 && arg->max_ == 1;
+    }
+    // returns a new node deleted with p
+    static BaseParser *make(BaseParser *p, Tag tag)
+    {
+      BaseParser *q = new BaseParser(tag);
+      p->obj_.push_back(q);
+      return q;
+    }
+
+    BaseParser                             *start_;     // start nonterminal
+    std::vector<BaseParser*>                nodes_;     // nodes reachable from start_
+    std::map<const BaseParser*,bool>        pure_;      // nodes without actions and flow variables
+    std::map<const BaseParser*,bool>        recursive_; // definitions that can call themselves
+    std::map<const BaseParser*,BaseParser*> bodies_;    // alternations of the alternatives of inlined definitions
+};
+
+#endif
@@ -1,822 +1,1585 @@
-// syntax:
-//
-// Parser<> nt;
-// Parser<InOutType> nt;
-// Parser<InType,OutType> nt;
-//
-// Construction of parser objects given parser objects X and Y:
-//
-// X & Y                concatenation
-// X | Y                alternation
-// *X                   repeat
-// +X                   nonzero repeat
-// -X                   optional
-// ~X                   lookahead (match and backtrack)
-// !X                   negative lookahead (non-match and backtrack)
-// N * X                repeat N times
-// N-M * X              repeat N to M times
-// [&]{ ... }           action
-// 'A'                  a token with code 65 (ASCII value of 'A')
-// 65                   a token with code 65
-// Token('A')           a token with code 65 (ASCII value of 'A')
-// Token(65)            a token with code 65
-//
-//
-// When declaring a named terminal, make sure to always pass a token code
-// as an integer or a chacter:
-// Parser<> t(token_code); // token_code is an int or char
-//
-// When declaring (non)terminals, specify in/out types:
-// Parser<in-type,out-type> nt, t(tok_code);
-// if in-type and out-type are the same:
-// Parser<type> nt, t(tok_code);
-// if in-type and out-type are int:
-// Parser<> nt, t(tok_code);
-//
-//
-// Examples:
-// nt(in)>>out = ... & ... | ... & [&]{ ... }
-// nt(in)>>out = "token" & ...
-//
-// nt(in)  = ... & nt(in) & ...
-// nt>>out = ... & nt>>out & ...
-
-#ifndef PARSER
-#define PARSER
-
-#include <cassert>
-#include <functional> // std::function<void()>
-#include <vector>
-#include <stack>
-#include <typeinfo>   // typeid()
-#include <utility>    // std::swap(x,y)
-#include "debug.h"
-#include "parsetree.h"
-#include "tokenizer.h"
-#include "tokenstream.h"
-
-class parsing_error : public std::logic_error {
-public:
-  explicit parsing_error(const std::string& err)
-      : std::logic_error(err)
-  { };
-};
-
-class BaseParser
-{
-  friend class ParserPrinter;
-
-  public:
-    // constructors
-    BaseParser(char tok)
-    :
-      tok_code(tok),
-        tag_(Tag::TOK),
-        min_(1),
-        max_(1)
-    { }
-    BaseParser(int tok)
-      :
-        tok_code(tok),
-        tag_(Tag::TOK),
-        min_(1),
-        max_(1)
-    { }
-    template<typename F>
-    BaseParser(const F& act)
-      :
-        tag_(Tag::ACT),
-        act_(act),
-        min_(1),
-        max_(1)
-    { }
-    // destructor
-    virtual ~BaseParser()
-    {
-      for (auto p : obj_)
-      {
-        delete p;
-      }
-    }
-    // accessors
-    virtual void* get_in() const
-    {
-      return NULL;
-    }
-    virtual void* get_out() const
-    {
-      return NULL;
-    }
-    virtual const BaseParser* get_def() const
-    {
-      return this;
-    }
-    virtual const BaseParser* get_tok() const
-    {
-      return this;
-    }
-    virtual int get_tok_code() const
-    {
-      return 0;
-    }
-    // operator overloads
-    friend BaseParser& operator*(size_t n, BaseParser& arg)
-    {
-      BaseParser *p = &arg;
-      if (arg.tag_ != Tag::SEQ && arg.tag_ != Tag::ALT)
-      {
-        arg.obj_.push_back(p = new BaseParser(Tag::SEQ));
-        p->arg_.push_back(&arg);
-      }
-      p->min_ = p->max_ = n;
-      return *p;
-    }
-    friend const BaseParser& operator*(size_t n, const BaseParser& arg)
-    {
-      const BaseParser *p = &arg;
-      if (arg.tag_ != Tag::SEQ && arg.tag_ != Tag::ALT)
-      {
-        p = new BaseParser(Tag::SEQ);
-        p->arg_.push_back(p->clone(arg));
-        p->obj_.push_back(p);
-      }
-      p->min_ = p->max_ = n;
-      return *p;
-    }
-    friend BaseParser& operator-(size_t n, BaseParser& arg)
-    {
-      arg.min_ = n;
-      return arg;
-    }
-    friend const BaseParser& operator-(size_t n, const BaseParser& arg)
-    {
-      arg.min_ = n;
-      return arg;
-    }
-    friend BaseParser& operator*(BaseParser& arg)
-    {
-      return 0 - MAX * arg;
-    }
-    friend const BaseParser& operator*(const BaseParser& arg)
-    {
-      return 0 - MAX * arg;
-    }
-    friend BaseParser& operator+(BaseParser& arg)
-    {
-      return 1 - MAX * arg;
-    }
-    friend const BaseParser& operator+(const BaseParser& arg)
-    {
-      return 1 - MAX * arg;
-    }
-    friend BaseParser& operator-(BaseParser& arg)
-    {
-      return 0 - 1 * arg;
-    }
-    friend const BaseParser& operator-(const BaseParser& arg)
-    {
-      return 0 - 1 * arg;
-    }
-    friend BaseParser& operator~(BaseParser& arg)
-    {
-      return 1 - 0 * arg;
-    }
-    friend const BaseParser& operator~(const BaseParser& arg)
-    {
-      return 1 - 0 * arg;
-    }
-    friend BaseParser& operator!(BaseParser& arg)
-    {
-      return 0 - 0 * arg;
-    }
-    friend const BaseParser& operator!(const BaseParser& arg)
-    {
-      return 0 - 0 * arg;
-    }
-    friend BaseParser& operator&(BaseParser& arg1, BaseParser& arg2)
-    {
-      BaseParser *p = &arg1;
-      if (arg1.tag_ != Tag::SEQ || arg1.min_ != 1 || arg1.max_ != 1)
-      {
-        arg1.obj_.push_back(p = new BaseParser(Tag::SEQ));
-        p->arg_.push_back(&arg1);
-      }
-      p->arg_.push_back(&arg2);
-      return *p;
-    }
-    friend BaseParser& operator&(const BaseParser& arg1, BaseParser& arg2)
-    {
-      return *arg2.clone(arg1) & arg2;
-    }
-    friend BaseParser& operator&(BaseParser& arg1, const BaseParser& arg2)
-    {
-      return arg1 & *arg1.clone(arg2);
-    }
-    friend const BaseParser& operator&(const BaseParser& arg1, const BaseParser& arg2)
-    {
-      const BaseParser *p = new BaseParser(Tag::SEQ);
-      p->arg_.push_back(p->clone(arg1));
-      p->arg_.push_back(p->clone(arg2));
-      p->obj_.push_back(p);
-      return *p;
-    }
-    friend BaseParser& operator|(BaseParser& arg1, BaseParser& arg2)
-    {
-      BaseParser *p = &arg1;
-      if (arg1.tag_ != Tag::ALT || arg1.min_ != 1 || arg1.max_ != 1)
-      {
-        arg1.obj_.push_back(p = new BaseParser(Tag::ALT));
-        p->arg_.push_back(&arg1);
-      }
-      p->arg_.push_back(&arg2);
-      return *p;
-    }
-    friend BaseParser& operator|(const BaseParser& arg1, BaseParser& arg2)
-    {
-      return *arg2.clone(arg1) | arg2;
-    }
-    friend BaseParser& operator|(BaseParser& arg1, const BaseParser& arg2)
-    {
-      return arg1 | *arg1.clone(arg2);
-    }
-    friend BaseParser& operator|(const BaseParser& arg1, const BaseParser& arg2)
-    {
-      BaseParser *p = new BaseParser(Tag::ALT);
-      p->arg_.push_back(p->clone(arg1));
-      p->arg_.push_back(p->clone(arg2));
-      p->obj_.push_back(p);
-      return *p;
-    }
-    friend BaseParser& operator&(int tok, BaseParser& arg)
-    {
-      BaseParser temp(tok);
-      return *arg.clone(temp) & arg;
-    }
-    friend BaseParser& operator&(int tok, const BaseParser& arg)
-    {
-      BaseParser temp(tok);
-      BaseParser *p = arg.clone();
-      return *p & *p->clone(temp);
-    }
-    friend BaseParser& operator&(BaseParser& arg, int tok)
-    {
-      BaseParser temp(tok);
-      return arg & *arg.clone(temp);
-    }
-    friend BaseParser& operator&(const BaseParser& arg, int tok)
-    {
-      BaseParser temp(tok);
-      BaseParser *p = arg.clone();
-      return *p & *p->clone(temp);
-    }
-    friend BaseParser& operator|(int tok, BaseParser& arg)
-    {
-      BaseParser temp(tok);
-      return *arg.clone(temp) | arg;
-    }
-    friend BaseParser& operator|(int tok, const BaseParser& arg)
-    {
-      BaseParser temp(tok);
-      BaseParser *p = arg.clone();
-      return *p->clone(temp) | *p;
-    }
-    friend BaseParser& operator|(BaseParser& arg, int tok)
-    {
-      BaseParser temp(tok);
-      return arg | *arg.clone(temp);
-    }
-    friend BaseParser& operator|(const BaseParser& arg, int tok)
-    {
-      BaseParser temp(tok);
-      BaseParser *p = arg.clone();
-      return arg | *p->clone(temp);
-    }
-    // parsing engine
-    virtual bool parse(size_t& pos, Tokenizer *tokens, ParseTree *tree = NULL)
-    { 
-      
-      if (tag_ == Tag::ACT)
-      {
-        // execute action closure (ignore repeats/optional)
-        try {
-          act_();
-        } catch (parsing_error&) { return false; }
-
-        return true;
-      }
-      if (tag_ == Tag::SEQ)
-      {
-        if (max_ > 0)
-        {
-          // parse sequence X&Y with repeats/optional *(X&Y), +(X&Y), -(X&Y)
-          for (size_t k = 0; k < max_; ++k)
-          {
-            size_t p = pos;
-            std::vector<ParseTree> children;
-            for (auto a : arg_)
-            {
-              ParseTree child;
-              if (!a->parse(pos, tokens, tree ? &child : NULL))
-              {
-                if (k < min_)
-                {
-                  return false;
-                } 
-                pos = p;
-                DBGLOG("SEQ PASSED");
-                return true;
-              } else if (tree) {
-                // Store child temp until all args of SEQ have passed
-                if (child.has_parent())
-                  children.emplace_back(child);
-                else if (child.get_children()->size() > 0)
-                  for (auto x : *child.get_children())
-                    children.emplace_back(x);
-              }
-            }
-            // Store children saved in tree because all args in SEQ passed
-            if (tree)
-              for (auto child : children)
-                tree->add_child(child);
-          }
-          return true;
-        }
-        else
-        {
-          bool ok = min_ > 0; // (negative) lookahead
-          // lookahead sequence (X&Y)
-          size_t p = pos;
-          std::vector<ParseTree> children;
-          for (auto a : arg_)
-          {
-            ParseTree child;
-            if (!a->parse(pos, tokens, tree ? &child : NULL))
-            {
-              pos = p;
-              return !ok;
-            } else if (ok && tree) {
-              // Store child temp until all args of SEQ have passed
-              if (child.has_parent())
-                children.emplace_back(child);
-              else if (child.get_children()->size() > 0)
-                for (auto x : *child.get_children())
-                  children.emplace_back(x);
-            }
-          }
-          if (ok && tree)
-            for (auto child : children)
-              tree->add_child(child);
-          pos = p;
-          return ok;
-        }
-      }
-      if (tag_ == Tag::ALT)
-      {
-        if (max_ > 0)
-        {
-          // parse alternations (X|Y) with repeats/optional *(X|Y), +(X|Y), -(X|Y)
-          for (size_t k = 0; k < max_; ++k)
-          {
-            size_t p = pos;
-            ParseTree child;
-            for (auto a : arg_)
-            {
-              pos = p; 
-              child = ParseTree();
-              if (a->parse(pos, tokens, tree ? &child : NULL))
-              {
-                if (tree)
-                {
-                  // else if handles repeats
-                  if (child.has_parent())
-                    tree->add_child(child);
-                  else if (child.get_children()->size() > 0)
-                    for (auto x : *child.get_children())
-                      tree->add_child(x);
-                }
-                goto next; // continue outer loop
-              }
-            }
-            if (k < min_)
-              return false;
-            return true;
-          next:
-            continue;
-          }
-          return true;
-        }
-        else
-        {
-          bool ok = min_ > 0; // (negative) lookahead
-          // lookahead alternations (X|Y)
-          size_t p = pos;
-          for (auto a : arg_)
-          {
-            pos = p;
-            ParseTree child;
-            if (a->parse(pos, tokens, tree ? &child : NULL))
-            {
-              pos = p;
-              if (ok && tree)
-              {
-                // else if handles repeats
-                if (child.has_parent())
-                  tree->add_child(child);
-                else if (child.get_children()->size() > 0)
-                  for (auto x : *child.get_children())
-                    tree->add_child(x);
-              }
-              return ok;
-            }
-          }
-          pos = p;
-          return !ok;
-        }
-      }
-      if (tag_ == Tag::TOK)
-      {
-        if (tokens->has_pos(pos))
-        if (tokens->has_pos(pos) && tokens->at(pos).code == tok_code)
-        {
-          if (tree)
-          {
-            tree->set_parent(tokens->at(pos).text);
-          }
-          ++pos;
-          return true;
-        }
-        return false; 
-      }
-      return false;
-    }
-  protected:
-    
-    enum class Tag { DEF, NON, TOK, ACT, SEQ, ALT };
-    typedef std::function<void()> Action;
-    static const size_t MAX = ~static_cast<size_t>(0);
-    
-    // constructors
-    explicit BaseParser(Tag tag)
-      :
-        tag_(tag),
-        min_(1),
-        max_(1)
-    { }
-    explicit BaseParser(const BaseParser& arg)
-      :
-        tok_code(arg.tok_code),
-        tag_(arg.tag_),
-        act_(arg.act_),
-        min_(arg.min_),
-        max_(arg.max_)
-    {
-      std::swap(arg_, arg.arg_); // arg loses all its args
-      std::swap(obj_, arg.obj_); // delegate deletion to the new object
-    }
-
-    // helper functions
-    BaseParser *clone(const BaseParser& arg) const
-    {
-      BaseParser *p = arg.clone();
-      obj_.push_back(p);
-      return p;
-    }
-    virtual BaseParser *clone() const
-    {
-      BaseParser *p = new BaseParser(*this); // this object loses its args
-      return p;
-    }
-    virtual void save(void *except)
-    {
-      for (auto a : arg_)
-        a->save(except);
-    }
-    virtual void restore(void *except)
-    {
-      for (auto a : arg_)
-        a->restore(except);
-    }
-
-    // member data
-    int                                     tok_code; // token code
-    Tag                                     tag_; // selector
-    Action                                  act_; // action closure
-    mutable size_t                          min_; // min of *X and +X repeats (0/1), -X optional (0), ~X and !X lookahead (1/0)
-    mutable size_t                          max_; // max of *X and +X repeats (MAX), -X optional (1), ~X and !X lookahead (0)
-    mutable std::vector<BaseParser*>        arg_; // arguments of SEQ and ALT
-    mutable std::vector<const BaseParser*>  obj_; // collection of clones to delete
-};
-
-template<typename InType = int, typename OutType = InType>
-class Parser : public BaseParser 
-{
-  friend class BaseParser;
-  public:
-    // constructors
-    Parser()
-      :
-        BaseParser(Tag::DEF),
-        def_(NULL),
-        tok_(NULL),
-        in_(NULL),
-        out_(NULL)
-    { }
-    Parser(int tok)
-      :
-        BaseParser(tok),
-        def_(NULL),
-        tok_(this),
-        in_(NULL),
-        out_(NULL)
-    {
-    }
-    explicit Parser(const Parser&) = default;
-   
-    // accessors
-    virtual void* get_in() const
-    {
-      return in_;
-    }
-    virtual void* get_out() const
-    {
-      return out_;
-    }
-    virtual const Parser* get_def() const
-    {
-      return def_ ? def_ : this;
-    }
-    virtual const Parser* get_tok() const
-    {
-      return tok_ ? tok_ : this;
-    }
-    virtual int get_tok_code() const
-    {
-      return tok_code;
-    }
-    static size_t lineno(Tokenizer *tokens, size_t pos)
-    {
-      return tokens->at(pos).lineno;
-    }
-    static size_t columno(Tokenizer *tokens, size_t pos)
-    {
-      return tokens->at(pos).columno;
-    }
-    
-    // operator overloads
-    Parser& operator()(InType& in)
-    {
-      assert(tag_ == Tag::DEF || tag_ == Tag::TOK);
-      Parser *p = this;
-      if (tag_ == Tag::DEF)
-        obj_.push_back(p = new Parser(this, &in, out_));
-      else if (tag_ == Tag::TOK)
-        obj_.push_back(p = new Parser(this, tok_code, &in, out_));
-      return *p;
-    }
-    friend Parser& operator>>(Parser& arg, OutType& out)
-    {
-      assert(arg.tag_ == Tag::DEF || arg.tag_ == Tag::NON || arg.tag_ == Tag::TOK);
-      Parser *p = &arg;
-      if (arg.tag_ == Tag::DEF)
-        arg.obj_.push_back(p = new Parser(&arg, arg.in_, &out));
-      else if (arg.tag_ == Tag::TOK)
-        arg.obj_.push_back(p = new Parser(arg.tok_, arg.tok_code, arg.in_, &out));
-      p->out_ = &out;
-      return *p;
-    }
-    Parser& operator=(int tok)
-    {
-      assert(tag_ == Tag::DEF || tag_ == Tag::NON);
-      Parser *p = this;
-      if (tag_ == Tag::DEF)
-      {
-        obj_.push_back(p = new Parser(Tag::TOK));
-        arg_.push_back(p);
-      }
-      else if (tag_ == Tag::NON)
-      {
-        assert(def_ != NULL);
-        def_->obj_.push_back(p = new Parser(Tag::TOK));
-        def_->arg_.push_back(p);
-      }
-      p->tok_code = tok;
-      return *this;
-    }
-    Parser& operator=(Parser& rhs)
-    {
-      return operator=(dynamic_cast<BaseParser&>(rhs)); // could never NULL the pointer
-    }
-    Parser& operator=(const Parser& rhs)
-    {
-      return operator=(*clone(rhs));
-    }
-    Parser& operator=(BaseParser& rhs)
-    {
-      assert(tag_ == Tag::DEF || tag_ == Tag::NON);
-      Parser *lhs = this;
-      if (tag_ == Tag::NON)
-      {
-        lhs = def_;
-        if (lhs->in_ == NULL)
-          lhs->in_ = in_;
-        else
-          assert(lhs->in_ == in_); // must use same input arg
-        if (lhs->out_ == NULL)
-          lhs->out_ = out_;
-        else
-          assert(lhs->out_ == out_); // must use same output arg
-      }
-      lhs->arg_.push_back(&rhs);
-      return *this;
-    }
-    Parser& operator=(const BaseParser& rhs)
-    {
-      return operator=(*clone(rhs));
-    }
-    
-    // parsing engine
-    bool parse(Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
-    {
-      if (pos && !tokens->has_pos(*pos))
-        return false;
-      size_t p = 0;
-      if (tree)
-        tree->clear();
-      return parse(pos ? *pos : p, tokens, tree);
-    }
-    virtual bool parse(size_t & pos, Tokenizer *tokens, ParseTree *tree = NULL)
-    {
-      if (tag_ == Tag::DEF)
-      {
-        ParseTree child;
-        // parse nonterminal definitions (w/o in/out)
-        BaseParser::save(out_);
-        size_t p = pos;
-        for (auto a : arg_)
-        {
-          pos = p;
-          if (a->parse(pos, tokens, tree ? &child : NULL))
-          {
-            if (tree)
-            {
-              tree->set_parent(this);
-              if (child.has_parent())
-                tree->add_child(child);
-              else
-                for (auto x : *child.get_children())
-                  tree->add_child(x);
-            }
-            BaseParser::restore(out_);
-            return true;
-          }
-        }
-        BaseParser::restore(out_);
-        tree = NULL;
-        return false;
-      }
-      if (tag_ == Tag::NON)
-      {
-        // parse nonterminal w/ in/out
-        assert(def_ != NULL);
-        assert(def_->in_ || def_->out_); // this is a NON, not a DEF that has no IO
-        assert(!def_->in_ || in_); // no input arg, when one is required, parhaps default initialize input?
-        bool ok;
-        if ((void*)def_->in_ == (void*)def_->out_ &&
-            typeid(def_->in_) == typeid(def_->out_)) // formal in == out
-        {
-          OutType tmpo;
-          if (def_->out_ != out_)
-            std::swap(tmpo, *def_->out_);
-          if (def_->in_ != in_)
-          {
-            std::swap(*def_->in_, *in_);
-          }
-          ok = def_->parse(pos, tokens, tree);
-          if (def_->out_ != out_)
-          {
-            if (out_)
-              std::swap(*out_, *def_->out_);
-            std::swap(*def_->out_,  tmpo);
-          }
-        }
-        else
-        {
-          InType tmpi;
-          if (def_->in_ && def_->in_ != in_)
-          {
-            std::swap(tmpi, *def_->in_);
-            std::swap(*def_->in_, *in_);
-          }
-          OutType tmpo;
-          if (def_->out_ && def_->out_ != out_)
-            std::swap(tmpo, *def_->out_);
-          ok = def_->parse(pos, tokens, tree);
-          if (def_->in_ && def_->in_ != in_)
-          {
-            std::swap(*in_, *def_->in_);
-            std::swap(*def_->in_, tmpi);
-          }
-          if (def_->out_ && def_->out_ != out_)
-          {
-            if (out_)
-              std::swap(*out_, *def_->out_);
-            std::swap(*def_->out_,  tmpo);
-          }
-        }
-        return ok;
-      }
-      if (tag_ == Tag::TOK)
-      {
-        if (tokens->has_pos(pos))
-        if (tokens->has_pos(pos) && tokens->at(pos).code == tok_code)
-        {
-          if (out_)
-          {
-            TokenStream<InType> tok_stream(tokens->at(pos).code, tokens->at(pos).text, in_);
-            try
-            {
-              tok_stream >> *out_;
-            } catch (extraction_error&) { return false; }
-          }
-          if (tree)
-          {
-            tree->set_parent(tokens->at(pos).text);
-          }
-          ++pos;
-          return true;
-        }
-        return false; 
-      }
-      return BaseParser::parse(pos, tokens, tree);
-    }
-
-  protected:
-    // constructors
-    Parser(
-        Parser  *def,
-        InType  *in,
-        OutType *out)
-      :
-        BaseParser(Tag::NON),
-        def_(def),
-        tok_(NULL),
-        in_(in),
-        out_(out)
-    { }
-    Parser(
-        Parser      *tok,
-        int         code,
-        InType      *in,
-        OutType     *out)
-      :
-        BaseParser(code),
-        def_(NULL),
-        tok_(tok),
-        in_(in),
-        out_(out)
-    { }
-    explicit Parser(Tag tag)
-      :
-        BaseParser(tag)
-    { }
-
-    // helper functions
-    using BaseParser::clone;
-    virtual BaseParser *clone() const
-    {
-      Parser *p = new Parser(*this);
-      return p;
-    }
-    virtual void save(void *except)
-    {
-      if (tag_ == Tag::NON || tag_ == Tag::TOK)
-      {
-        if (out_ && out_ != except)
-        {
-          stk_.push(*out_);
-        }
-      }
-    }
-    virtual void restore(void *except)
-    {
-      if (tag_ == Tag::NON || tag_ == Tag::TOK)
-      {
-        if (out_ && out_ != except)
-        {
-          *out_ = stk_.top();
-          stk_.pop();
-        }
-      }
-    }
-
-    // member data
-    Parser             *def_;
-    Parser             *tok_;
-    InType             *in_;
-    OutType            *out_;
-    std::stack<OutType> stk_;
-};
-
-// allows Token('a') and Token(15) syntax
-typedef BaseParser Token;
-#endif
+// syntax:
+//
+// Parser<> nt;
+// Parser<InOutType> nt;
+// Parser<InType,OutType> nt;
+//
+// Construction of parser objects given parser objects X and Y:
+//
+// X & Y                concatenation
+// X | Y                alternation
+// *X                   repeat
+// +X                   nonzero repeat
+// -X                   optional
+// ~X                   lookahead (match and backtrack)
+// !X                   negative lookahead (non-match and backtrack)
+// N * X                repeat N times
+// N-M * X              repeat N to M times
+// [&]{ ... }           action
+// 'A'                  a token with code 65 (ASCII value of 'A')
+// 65                   a token with code 65
+// Token('A')           a token with code 65 (ASCII value of 'A')
+// Token(65)            a token with code 65
+// Token({'0','1'})     a token with code 48 or 49
+//
+//
+// When declaring a named terminal, make sure to always pass a token code
+// as an integer or a chacter:
+// Parser<> t(token_code); // token_code is an int or char
+// or a set of token codes, matched with one lookup in a TokenSet:
+// Parser<> t({token_code, ...});
+//
+// When declaring (non)terminals, specify in/out types:
+// Parser<in-type,out-type> nt, t(tok_code);
+// if in-type and out-type are the same:
+// Parser<type> nt, t(tok_code);
+// if in-type and out-type are int:
+// Parser<> nt, t(tok_code);
+//
+//
+// Examples:
+// nt(in)>>out = ... & ... | ... & [&]{ ... }
+// nt(in)>>out = "token" & ...
+//
+// nt(in)  = ... & nt(in) & ...
+// nt>>out = ... & nt>>out & ...
+//
+// Packrat parsing (opt-in per nonterminal):
+//
+// nt.memoize();        memoize the results of nt per token position
+// nt.memoize(N);       same, but keep at most N results of nt
+//
+// A memoized nonterminal is parsed at most once per position, which avoids
+// exponential backtracking.  Its actions are not re-executed when its result
+// is reused, so only memoize nonterminals whose result depends on the token
+// position and the value of its in-flow variable.
+//
+// Left recursion:
+//
+// expr>>a = expr>>a & '+' & term>>b & [&]{ a += b; } | term>>a;
+//
+// A (directly or indirectly) left-recursive nonterminal first fails its
+// recursive call to obtain a seed parse, then grows the seed by reparsing
+// with the recursive call matching the previous parse, until the parse no
+// longer extends.  Operators thus associate to the left.
+//
+// Sharing a grammar between threads:
+//
+// start.freeze();              make the grammar immutable
+// start.parse(ctx, &tokens);   parse with the state kept in Context ctx
+//
+// Threads that parse with their own Context share a frozen grammar.  Actions
+// must be safe to execute concurrently.  Flow variables are the program's
+// variables, shared by all parses: parses of a grammar with flow variables
+// must run in turn, e.g. under a mutex.  Index the grammar with
+// Analysis::index() before freezing it.
+//
+// Reparsing after an edit:
+//
+// start.parse(&tokens, &pos, &tree);                      parse a document
+// start.reparse(&tokens, from, to, edit, &pos, &tree);    replace tokens from up to to by edit and parse again
+//
+// A reparse reuses the memoized results of the last parse that the edit
+// does not affect, with their subtrees: results of parses that only looked
+// at tokens before the edit, and results of parses after the edit, which
+// move with the tokens.  The parses that looked at the edited tokens, which
+// include the tokens their lookaheads and failed alternatives looked at, are
+// parsed again.  Memoize the nonterminals of a document whose results
+// should be reused, e.g. its sections or entries, and pass the same tree to
+// parse() and reparse().  The nodes of a tree are not released until the
+// next parse() without reparse(), which clears the tree.
+//
+// Profiling a grammar, compiled with -DPARSER_PROFILE:
+//
+// Profiler prof;               measures the parses of each definition, see profiler.h
+// Profiler::Use use(prof);     profile the parses of this thread
+// prof.report(std::cout);      table of calls, failures, backtracked tokens and time
+//
+// Diagnosing a failed parse:
+//
+// Result r = start.parse_result(&tokens);
+// if (!r)
+//   ... r.farthest is the position of the error, r.expected the codes of the tokens expected there
+//
+// A parse records the farthest position at which it failed to match a token
+// and the nodes that failed there, so a rejected input is diagnosed in the
+// same pass, without parsing it again in a DEBUG build.  The codes expected
+// by lookaheads are included.
+
+#ifndef PARSER
+#define PARSER
+
+#include <algorithm>  // std::sort(), std::unique()
+#include <cassert>
+#include <map>
+#include <set>
+#include <memory>     // std::unique_ptr
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <typeinfo>   // typeid()
+#include <utility>    // std::swap(x,y)
+#include "action.h"
+#include "context.h"
+#include "debug.h"
+#include "memoryresource.h"
+#include "parsetree.h"
+#include "tokenizer.h"
+#include "tokenset.h"
+#include "tokenstream.h"
+
+#ifdef PARSER_PROFILE
+#include "profiler.h"
+#define PROFILE_ENTER(def) Profiler::Scope profile(def)
+#define PROFILE_LEAVE(ok, memo, backtracked) profile.leave(ok, memo, backtracked)
+#else
+#define PROFILE_ENTER(def) (void)0
+#define PROFILE_LEAVE(ok, memo, backtracked) (void)0
+#endif
+
+class parsing_error : public std::logic_error {
+public:
+  explicit parsing_error(const std::string& err)
+      : std::logic_error(err)
+  { };
+};
+
+// outcome of a parse, see parse_result()
+struct Result
+{
+  Result()
+    :
+      ok(false),
+      pos(0),
+      farthest(0)
+  { }
+  bool             ok;       ///< parse succeeded
+  size_t           pos;      ///< position after the parse, the position the parse started at when !ok
+  size_t           farthest; ///< farthest position at which a token did not match, the position of the error when !ok
+  std::vector<int> expected; ///< codes of the tokens expected at farthest, sorted
+  explicit operator bool() const
+  {
+    return ok;
+  }
+};
+
+class BaseParser
+{
+  friend class ParserPrinter;
+  friend class Program;
+  template<typename,typename> friend class Parser;
+  friend class Analysis;
+  friend class Optimizer;
+
+  public:
+    // constructors
+    BaseParser(char tok)
+    :
+      tok_code(tok),
+        tag_(Tag::TOK),
+        min_(1),
+        max_(1)
+    { }
+    BaseParser(int tok)
+      :
+        tok_code(tok),
+        tag_(Tag::TOK),
+        min_(1),
+        max_(1)
+    { }
+    BaseParser(std::initializer_list<int> codes)
+      :
+        tok_code(codes.size() > 0 ? *codes.begin() : 0),
+        tag_(Tag::TOK),
+        min_(1),
+        max_(1),
+        set_(std::allocate_shared<TokenSet>(Allocator<TokenSet>(), codes))
+    { }
+    template<typename F>
+    BaseParser(const F& act)
+      :
+        tag_(Tag::ACT),
+        act_(act),
+        min_(1),
+        max_(1)
+    { }
+    // destructor
+    virtual ~BaseParser()
+    {
+      for (auto p : obj_)
+      {
+        delete p;
+      }
+    }
+    /// allocate a node of a grammar from the current MemoryResource of the thread, see memoryresource.h
+    static void *operator new(size_t size)
+    {
+      MemoryResource *memory = MemoryResource::current();
+      char *p = static_cast<char*>(memory->allocate(HEADER + size));
+      *reinterpret_cast<MemoryResource**>(p) = memory; // the resource to release the node to
+      return p + HEADER;
+    }
+    /// release a node of a grammar to the MemoryResource it was allocated from
+    static void operator delete(void *p, size_t size)
+    {
+      char *q = static_cast<char*>(p) - HEADER;
+      (*reinterpret_cast<MemoryResource**>(q))->deallocate(q, HEADER + size);
+    }
+    // accessors
+    virtual void* get_in() const
+    {
+      return NULL;
+    }
+    virtual void* get_out() const
+    {
+      return NULL;
+    }
+    virtual const BaseParser* get_def() const
+    {
+      return this;
+    }
+    virtual const BaseParser* get_tok() const
+    {
+      return this;
+    }
+    virtual int get_tok_code() const
+    {
+      return 0;
+    }
+    virtual size_t get_memo() const
+    {
+      return 0;
+    }
+    /// make the grammar of this nonterminal immutable, so that threads that parse with their own Context can share it, see context.h
+    void freeze()
+    {
+      std::vector<BaseParser*> nodes;
+      std::set<BaseParser*> seen;
+      std::vector<BaseParser*> todo(1, this);
+      while (!todo.empty())
+      {
+        BaseParser *p = todo.back();
+        todo.pop_back();
+        if (!seen.insert(p).second)
+          continue;
+        nodes.push_back(p);
+        if (p->tag_ == Tag::NON)
+          todo.push_back(const_cast<BaseParser*>(p->get_def())); // a NON's def is never const
+        for (auto a : p->arg_)
+          todo.push_back(a);
+      }
+      for (auto p : nodes)
+        p->frozen();
+    }
+    /// replace the tokens from up to to by the tokens of edit and parse again, reusing the memoized results of the last parse that the edit does not affect
+    bool reparse(Tokenizer *tokens, size_t from, size_t to, const std::vector<Tokenizer::Token>& edit, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      size_t last = parses();
+      tokens->replace(from, to, edit);
+      begin();
+      if (tree)
+        tree->edit(from, to, edit.size());
+      std::set<BaseParser*> seen;
+      std::vector<BaseParser*> todo(1, this);
+      while (!todo.empty())
+      {
+        BaseParser *p = todo.back();
+        todo.pop_back();
+        if (!seen.insert(p).second)
+          continue;
+        p->edited(last, from, to, edit.size());
+        if (p->tag_ == Tag::NON)
+          todo.push_back(const_cast<BaseParser*>(p->get_def())); // a NON's def is never const
+        for (auto a : p->arg_)
+          todo.push_back(a);
+      }
+      if (pos && !tokens->has_pos(*pos))
+        return false;
+      size_t p = 0;
+      return parse(pos ? *pos : p, tokens, tree);
+    }
+    /// reparse() with the state of the parse kept in ctx, see context.h
+    bool reparse(Context& ctx, Tokenizer *tokens, size_t from, size_t to, const std::vector<Tokenizer::Token>& edit, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      Context::Use use(ctx);
+      return reparse(tokens, from, to, edit, pos, tree);
+    }
+    // operator overloads
+    friend BaseParser& operator*(size_t n, BaseParser& arg)
+    {
+      BaseParser *p = &arg;
+      if (arg.tag_ != Tag::SEQ && arg.tag_ != Tag::ALT)
+      {
+        arg.obj_.push_back(p = new BaseParser(Tag::SEQ));
+        p->arg_.push_back(&arg);
+      }
+      p->min_ = p->max_ = n;
+      return *p;
+    }
+    friend const BaseParser& operator*(size_t n, const BaseParser& arg)
+    {
+      const BaseParser *p = &arg;
+      if (arg.tag_ != Tag::SEQ && arg.tag_ != Tag::ALT)
+      {
+        p = temporary(Tag::SEQ);
+        p->arg_.push_back(p->own(arg));
+      }
+      p->min_ = p->max_ = n;
+      return *p;
+    }
+    friend BaseParser& operator-(size_t n, BaseParser& arg)
+    {
+      arg.min_ = n;
+      return arg;
+    }
+    friend const BaseParser& operator-(size_t n, const BaseParser& arg)
+    {
+      arg.min_ = n;
+      return arg;
+    }
+    friend BaseParser& operator*(BaseParser& arg)
+    {
+      return 0 - MAX * arg;
+    }
+    friend const BaseParser& operator*(const BaseParser& arg)
+    {
+      return 0 - MAX * arg;
+    }
+    friend BaseParser& operator+(BaseParser& arg)
+    {
+      return 1 - MAX * arg;
+    }
+    friend const BaseParser& operator+(const BaseParser& arg)
+    {
+      return 1 - MAX * arg;
+    }
+    friend BaseParser& operator-(BaseParser& arg)
+    {
+      return 0 - 1 * arg;
+    }
+    friend const BaseParser& operator-(const BaseParser& arg)
+    {
+      return 0 - 1 * arg;
+    }
+    friend BaseParser& operator~(BaseParser& arg)
+    {
+      return 1 - 0 * arg;
+    }
+    friend const BaseParser& operator~(const BaseParser& arg)
+    {
+      return 1 - 0 * arg;
+    }
+    friend BaseParser& operator!(BaseParser& arg)
+    {
+      return 0 - 0 * arg;
+    }
+    friend const BaseParser& operator!(const BaseParser& arg)
+    {
+      return 0 - 0 * arg;
+    }
+    friend BaseParser& operator&(BaseParser& arg1, BaseParser& arg2)
+    {
+      BaseParser *p = &arg1;
+      if (arg1.tag_ != Tag::SEQ || arg1.min_ != 1 || arg1.max_ != 1)
+      {
+        arg1.obj_.push_back(p = new BaseParser(Tag::SEQ));
+        p->arg_.push_back(&arg1);
+      }
+      p->arg_.push_back(&arg2);
+      return *p;
+    }
+    friend BaseParser& operator&(const BaseParser& arg1, BaseParser& arg2)
+    {
+      return *arg2.own(arg1) & arg2;
+    }
+    friend BaseParser& operator&(BaseParser& arg1, const BaseParser& arg2)
+    {
+      return arg1 & *arg1.own(arg2);
+    }
+    friend const BaseParser& operator&(const BaseParser& arg1, const BaseParser& arg2)
+    {
+      // extend a temporary sequence, as X&Y&Z is (X&Y)&Z
+      const BaseParser *p = &arg1;
+      if (!arg1.owns_itself() || arg1.tag_ != Tag::SEQ || arg1.min_ != 1 || arg1.max_ != 1)
+      {
+        p = temporary(Tag::SEQ);
+        p->arg_.push_back(p->own(arg1));
+      }
+      p->arg_.push_back(p->own(arg2));
+      return *p;
+    }
+    friend BaseParser& operator|(BaseParser& arg1, BaseParser& arg2)
+    {
+      BaseParser *p = &arg1;
+      if (arg1.tag_ != Tag::ALT || arg1.min_ != 1 || arg1.max_ != 1)
+      {
+        arg1.obj_.push_back(p = new BaseParser(Tag::ALT));
+        p->arg_.push_back(&arg1);
+      }
+      p->arg_.push_back(&arg2);
+      return *p;
+    }
+    friend BaseParser& operator|(const BaseParser& arg1, BaseParser& arg2)
+    {
+      return *arg2.own(arg1) | arg2;
+    }
+    friend BaseParser& operator|(BaseParser& arg1, const BaseParser& arg2)
+    {
+      return arg1 | *arg1.own(arg2);
+    }
+    friend const BaseParser& operator|(const BaseParser& arg1, const BaseParser& arg2)
+    {
+      // extend a temporary alternation, as X|Y|Z is (X|Y)|Z
+      const BaseParser *p = &arg1;
+      if (!arg1.owns_itself() || arg1.tag_ != Tag::ALT || arg1.min_ != 1 || arg1.max_ != 1)
+      {
+        p = temporary(Tag::ALT);
+        p->arg_.push_back(p->own(arg1));
+      }
+      p->arg_.push_back(p->own(arg2));
+      return *p;
+    }
+    friend BaseParser& operator&(int tok, BaseParser& arg)
+    {
+      return *arg.own(BaseParser(tok)) & arg;
+    }
+    friend const BaseParser& operator&(int tok, const BaseParser& arg)
+    {
+      return BaseParser(tok) & arg;
+    }
+    friend BaseParser& operator&(BaseParser& arg, int tok)
+    {
+      return arg & *arg.own(BaseParser(tok));
+    }
+    friend const BaseParser& operator&(const BaseParser& arg, int tok)
+    {
+      return arg & BaseParser(tok);
+    }
+    friend BaseParser& operator|(int tok, BaseParser& arg)
+    {
+      return *arg.own(BaseParser(tok)) | arg;
+    }
+    friend const BaseParser& operator|(int tok, const BaseParser& arg)
+    {
+      return BaseParser(tok) | arg;
+    }
+    friend BaseParser& operator|(BaseParser& arg, int tok)
+    {
+      return arg | *arg.own(BaseParser(tok));
+    }
+    friend const BaseParser& operator|(const BaseParser& arg, int tok)
+    {
+      return arg | BaseParser(tok);
+    }
+    // parsing engine
+    virtual bool parse(size_t& pos, Tokenizer *tokens, ParseTree *tree = NULL)
+    { 
+      
+      if (tag_ == Tag::ACT)
+      {
+        // execute action closure (ignore repeats/optional)
+        try {
+          act_();
+        } catch (parsing_error&) { return false; }
+
+        return true;
+      }
+      if ((tag_ == Tag::SEQ || tag_ == Tag::ALT) && max_ > 1)
+      {
+        // repeat of a token or of alternative tokens: match the run of their codes at once
+        int set[SPAN];
+        size_t n = span_codes(set);
+        const TokenSet *s = span_set();
+        if (n > 0 || s != NULL)
+        {
+          size_t k = n > 0 ? tokens->span(pos, set, n, max_) : tokens->span(pos, *s, max_);
+          if (k < max_)
+            expect(pos + k, this);
+          if (k < min_)
+            return false;
+          if (tree)
+            for (size_t j = 0; j < k; ++j)
+              tree->push_token(tokens, pos + j);
+          pos += k;
+          return true;
+        }
+      }
+      if (tag_ == Tag::SEQ)
+      {
+        if (max_ > 0)
+        {
+          // parse sequence X&Y with repeats/optional *(X&Y), +(X&Y), -(X&Y)
+          ParseTree::Mark start;
+          if (tree)
+            start = tree->mark();
+          for (size_t k = 0; k < max_; ++k)
+          {
+            size_t p = pos;
+            ParseTree::Mark m;
+            if (tree)
+              m = tree->mark();
+            for (auto a : arg_)
+            {
+              if (!a->parse(pos, tokens, tree))
+              {
+                if (k < min_)
+                {
+                  if (tree)
+                    tree->release(start);
+                  return false;
+                } 
+                // release the subtrees of the args of SEQ that passed
+                if (tree)
+                  tree->release(m);
+                pos = p;
+                DBGLOG("SEQ PASSED");
+                return true;
+              }
+            }
+          }
+          return true;
+        }
+        else
+        {
+          bool ok = min_ > 0; // (negative) lookahead
+          // lookahead sequence (X&Y)
+          size_t p = pos;
+          ParseTree::Mark m;
+          if (tree)
+            m = tree->mark();
+          for (auto a : arg_)
+          {
+            if (!a->parse(pos, tokens, tree))
+            {
+              if (tree)
+                tree->release(m);
+              pos = p;
+              return !ok;
+            }
+          }
+          reached(pos);
+          if (!ok && tree)
+            tree->release(m);
+          pos = p;
+          return ok;
+        }
+      }
+      if (tag_ == Tag::ALT)
+      {
+        if (max_ > 0)
+        {
+          // parse alternations (X|Y) with repeats/optional *(X|Y), +(X|Y), -(X|Y)
+          ParseTree::Mark start;
+          if (tree)
+            start = tree->mark();
+          for (size_t k = 0; k < max_; ++k)
+          {
+            size_t p = pos;
+            for (auto a : alternatives(pos, tokens))
+            {
+              pos = p; 
+              if (a->parse(pos, tokens, tree))
+                goto next; // continue outer loop
+            }
+            if (k < min_)
+            {
+              if (tree)
+                tree->release(start);
+              return false;
+            }
+            pos = p;
+            return true;
+          next:
+            continue;
+          }
+          return true;
+        }
+        else
+        {
+          bool ok = min_ > 0; // (negative) lookahead
+          // lookahead alternations (X|Y)
+          size_t p = pos;
+          ParseTree::Mark m;
+          if (tree)
+            m = tree->mark();
+          for (auto a : alternatives(pos, tokens))
+          {
+            pos = p;
+            if (a->parse(pos, tokens, tree))
+            {
+              reached(pos);
+              if (!ok && tree)
+                tree->release(m);
+              pos = p;
+              return ok;
+            }
+          }
+          pos = p;
+          return !ok;
+        }
+      }
+      if (tag_ == Tag::TOK)
+      {
+        if (tokens->has_pos(pos))
+        if (tokens->has_pos(pos) && matches(tokens->code(pos)))
+        {
+          if (tree)
+          {
+            tree->push_token(tokens, pos);
+          }
+          ++pos;
+          return true;
+        }
+        expect(pos, this);
+        return false; 
+      }
+      return false;
+    }
+  protected:
+    
+    enum class Tag { DEF, NON, TOK, ACT, SEQ, ALT };
+    typedef std::vector<BaseParser*,Allocator<BaseParser*> >             Nodes; // nodes, allocated from the current MemoryResource
+    typedef std::vector<const BaseParser*,Allocator<const BaseParser*> > Owned; // nodes owned by a node
+    // alternatives of an ALT indexed by the codes of the tokens they can start with
+    struct Index
+    {
+      std::unordered_map<int,Nodes> alts;  // alternatives to try for a token code
+      Nodes                         other; // alternatives to try for other codes and at the end
+    };
+    static const size_t MAX = ~static_cast<size_t>(0);
+    static const size_t MEMO = 65536; // default max number of memoized results per nonterminal
+    static const size_t SPAN = 8;     // max number of token codes of a repeat matched with Tokenizer::span()
+    static const size_t HEADER = MemoryResource::ALIGN; // bytes in front of a node that hold its MemoryResource
+    // thrown by a definition parse beyond limit() to abandon the parse, see Program::limit()
+    struct Exceeded
+    { };
+    
+    // constructors
+    explicit BaseParser(Tag tag)
+      :
+        tag_(tag),
+        min_(1),
+        max_(1)
+    { }
+    explicit BaseParser(const BaseParser& arg)
+      :
+        tok_code(arg.tok_code),
+        tag_(arg.tag_),
+        act_(arg.act_),
+        min_(arg.min_),
+        max_(arg.max_),
+        set_(arg.set_)
+    {
+      std::swap(arg_, arg.arg_); // arg loses all its args
+      std::swap(obj_, arg.obj_); // delegate deletion to the new object
+    }
+
+    // helper functions
+    static size_t& parses() // number of top-level parses, to expire memoized results
+    {
+      return Context::current()->parses_;
+    }
+    static size_t& depth() // number of active definition parses
+    {
+      return Context::current()->depth_;
+    }
+    static size_t& seeded() // least depth of a left recursion with a seed in use, or MAX
+    {
+      return Context::current()->seeded_;
+    }
+    static size_t& limit() // max number of active definition parses, set by a Program for the definitions it leaves to parse()
+    {
+      return Context::current()->limit_;
+    }
+    static void begin() // start a top-level parse
+    {
+      Context *ctx = Context::current();
+      ctx->expire(); // drops the states of destroyed frozen definitions
+      ++ctx->parses_; // expires the memo entries of previous parses
+      ctx->depth_ = 0;
+      ctx->seeded_ = MAX;
+      ctx->reach_ = 0;
+      ctx->farthest_ = 0;
+      ctx->expected_.clear();
+    }
+    static size_t& reach() // position after the last token looked at by the innermost definition parse
+    {
+      return Context::current()->reach_;
+    }
+    static void reached(size_t pos) // the innermost definition parse looked at the tokens before pos
+    {
+      Context *ctx = Context::current();
+      if (ctx->reach_ < pos)
+        ctx->reach_ = pos;
+    }
+    // record that node failed to match the token at pos
+    static void expect(size_t pos, const BaseParser *node)
+    {
+      Context *ctx = Context::current();
+      if (ctx->reach_ <= pos)
+        ctx->reach_ = pos + 1;
+      if (pos < ctx->farthest_)
+        return;
+      if (pos > ctx->farthest_)
+      {
+        ctx->farthest_ = pos;
+        ctx->expected_.clear();
+      }
+      else if (!ctx->expected_.empty() && ctx->expected_.back() == node)
+      {
+        return;
+      }
+      ctx->expected_.push_back(node);
+    }
+    // returns the result of the top-level parse that just ended
+    static Result result(bool ok, size_t pos)
+    {
+      Context *ctx = Context::current();
+      Result r;
+      r.ok = ok;
+      r.pos = pos;
+      r.farthest = ctx->farthest_;
+      for (auto node : ctx->expected_)
+        node->expected(r.expected);
+      std::sort(r.expected.begin(), r.expected.end());
+      r.expected.erase(std::unique(r.expected.begin(), r.expected.end()), r.expected.end());
+      return r;
+    }
+    // add the codes of the tokens this node expected to codes
+    void expected(std::vector<int>& codes) const
+    {
+      if (tag_ == Tag::TOK)
+      {
+        if (set_)
+          codes.insert(codes.end(), set_->codes().begin(), set_->codes().end());
+        else
+          codes.push_back(tok_code);
+      }
+      else if (idx_)
+      {
+        // an indexed alternation expects the codes of the alternatives it skips
+        for (auto& i : idx_->alts)
+          codes.push_back(i.first);
+      }
+      else if (span_set())
+      {
+        codes.insert(codes.end(), span_set()->codes().begin(), span_set()->codes().end());
+      }
+      else
+      {
+        int set[SPAN];
+        size_t n = span_codes(set);
+        codes.insert(codes.end(), set, set + n);
+      }
+    }
+    BaseParser *clone(const BaseParser& arg) const
+    {
+      BaseParser *p = arg.clone();
+      obj_.push_back(p);
+      return p;
+    }
+    // returns a new node for an operator to return as a temporary, which owns itself until it is adopted, see own()
+    static BaseParser *temporary(Tag tag)
+    {
+      BaseParser *p = new BaseParser(tag);
+      p->obj_.push_back(p);
+      return p;
+    }
+    // returns true if this node is a temporary that is not adopted yet
+    bool owns_itself() const
+    {
+      return !obj_.empty() && obj_.front() == this;
+    }
+    // returns arg as a node owned by this node: a temporary is adopted as is, any other node is cloned
+    BaseParser *own(const BaseParser& arg) const
+    {
+      if (!arg.owns_itself())
+        return clone(arg);
+      arg.obj_.front() = arg.obj_.back();
+      arg.obj_.pop_back();
+      obj_.push_back(&arg);
+      return const_cast<BaseParser*>(&arg); // a temporary is never const
+    }
+    virtual BaseParser *clone() const
+    {
+      BaseParser *p = new BaseParser(*this); // this object loses its args
+      return p;
+    }
+    // returns the alternatives of this ALT to try at pos
+    const Nodes& alternatives(size_t pos, Tokenizer *tokens) const
+    {
+      if (idx_.get() == NULL)
+        return arg_;
+      expect(pos, this);
+      if (tokens->has_pos(pos))
+      {
+        auto i = idx_->alts.find(tokens->code(pos));
+        if (i != idx_->alts.end())
+          return i->second;
+      }
+      return idx_->other;
+    }
+    // returns true if this TOK matches a token with the code
+    bool matches(int code) const
+    {
+      return set_ ? set_->contains(code) : code == tok_code;
+    }
+    // store the codes of the body of this SEQ or ALT in set when the body is a token or alternative tokens without out-flow, returns their number or 0
+    size_t span_codes(int *set) const
+    {
+      if (arg_.empty() || arg_.size() > SPAN || (tag_ == Tag::SEQ && arg_.size() > 1))
+        return 0;
+      for (size_t k = 0; k < arg_.size(); ++k)
+      {
+        if (arg_[k]->tag_ != Tag::TOK || arg_[k]->set_ || arg_[k]->get_out() != NULL)
+          return 0;
+        set[k] = arg_[k]->tok_code;
+      }
+      return arg_.size();
+    }
+    // returns the set of the body of this SEQ or ALT when the body is a token set without out-flow, or NULL
+    const TokenSet *span_set() const
+    {
+      if (arg_.size() != 1 || arg_[0]->tag_ != Tag::TOK || arg_[0]->get_out() != NULL)
+        return NULL;
+      return arg_[0]->set_.get();
+    }
+    // collect the nodes of this SEQ or ALT that update out-flow variables other than except, one node per variable
+    virtual void saves(void *except, std::vector<BaseParser*>& nodes)
+    {
+      for (auto a : arg_)
+        a->saves(except, nodes);
+    }
+    virtual void save() // save the out-flow variable of this NON or TOK
+    { }
+    virtual void restore() // restore the out-flow variable saved last
+    { }
+    virtual void frozen() // called by freeze() for each node of the grammar
+    { }
+    virtual void edited(size_t, size_t, size_t, size_t) // called by reparse() for each node of the grammar
+    { }
+    virtual void enter() // called by a Program when it enters a DEF or NON
+    { }
+    virtual void leave() // called by a Program when it leaves a DEF or NON
+    { }
+
+    // member data
+    int                                     tok_code; // token code
+    Tag                                     tag_; // selector
+    Action                                  act_; // action closure
+    mutable size_t                          min_; // min of *X and +X repeats (0/1), -X optional (0), ~X and !X lookahead (1/0)
+    mutable size_t                          max_; // max of *X and +X repeats (MAX), -X optional (1), ~X and !X lookahead (0)
+    mutable Nodes                           arg_; // arguments of SEQ and ALT
+    mutable Owned                           obj_; // collection of clones to delete, and this node while it is a temporary
+    std::unique_ptr<Index>                  idx_; // index of the alternatives of ALT, see analysis.h
+    std::shared_ptr<const TokenSet>         set_; // codes of a TOK that matches a set of tokens, or NULL
+};
+
+template<typename InType = int, typename OutType = InType>
+class Parser : public BaseParser 
+{
+  friend class BaseParser;
+  public:
+    // constructors
+    Parser()
+      :
+        BaseParser(Tag::DEF),
+        def_(NULL),
+        tok_(NULL),
+        in_(NULL),
+        out_(NULL),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    { }
+    Parser(int tok)
+      :
+        BaseParser(tok),
+        def_(NULL),
+        tok_(this),
+        in_(NULL),
+        out_(NULL),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    {
+    }
+    Parser(std::initializer_list<int> codes)
+      :
+        BaseParser(codes),
+        def_(NULL),
+        tok_(this),
+        in_(NULL),
+        out_(NULL),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    { }
+    explicit Parser(const Parser&) = default;
+    virtual ~Parser()
+    {
+      if (slot_ != MAX)
+        Context::release(slot_);
+    }
+   
+    // accessors
+    virtual void* get_in() const
+    {
+      return in_;
+    }
+    virtual void* get_out() const
+    {
+      return out_;
+    }
+    virtual const Parser* get_def() const
+    {
+      return def_ ? def_ : this;
+    }
+    virtual const Parser* get_tok() const
+    {
+      return tok_ ? tok_ : this;
+    }
+    virtual int get_tok_code() const
+    {
+      return tok_code;
+    }
+    virtual size_t get_memo() const
+    {
+      return memo_max_;
+    }
+    static size_t lineno(Tokenizer *tokens, size_t pos)
+    {
+      return tokens->at(pos).lineno;
+    }
+    static size_t columno(Tokenizer *tokens, size_t pos)
+    {
+      return tokens->at(pos).columno;
+    }
+    // memoize up to max results of this nonterminal (packrat parsing)
+    Parser& memoize(size_t max = MEMO)
+    {
+      assert(tag_ == Tag::DEF || tag_ == Tag::NON);
+      Parser *p = tag_ == Tag::NON ? def_ : this;
+      assert(p->slot_ == MAX); // the grammar is frozen
+      p->memo_max_ = max;
+      p->state_.memo.clear();
+      return *this;
+    }
+    
+    // operator overloads
+    Parser& operator()(InType& in)
+    {
+      assert(tag_ == Tag::DEF || tag_ == Tag::TOK);
+      Parser *p = this;
+      if (tag_ == Tag::DEF)
+        obj_.push_back(p = new Parser(this, &in, out_));
+      else if (tag_ == Tag::TOK)
+      {
+        obj_.push_back(p = new Parser(this, tok_code, &in, out_));
+        p->set_ = set_;
+      }
+      return *p;
+    }
+    friend Parser& operator>>(Parser& arg, OutType& out)
+    {
+      assert(arg.tag_ == Tag::DEF || arg.tag_ == Tag::NON || arg.tag_ == Tag::TOK);
+      Parser *p = &arg;
+      if (arg.tag_ == Tag::DEF)
+        arg.obj_.push_back(p = new Parser(&arg, arg.in_, &out));
+      else if (arg.tag_ == Tag::TOK)
+      {
+        arg.obj_.push_back(p = new Parser(arg.tok_, arg.tok_code, arg.in_, &out));
+        p->set_ = arg.set_;
+      }
+      p->out_ = &out;
+      return *p;
+    }
+    Parser& operator=(int tok)
+    {
+      assert(tag_ == Tag::DEF || tag_ == Tag::NON);
+      Parser *p = this;
+      if (tag_ == Tag::DEF)
+      {
+        obj_.push_back(p = new Parser(Tag::TOK));
+        arg_.push_back(p);
+      }
+      else if (tag_ == Tag::NON)
+      {
+        assert(def_ != NULL);
+        def_->obj_.push_back(p = new Parser(Tag::TOK));
+        def_->arg_.push_back(p);
+      }
+      (tag_ == Tag::DEF ? this : def_)->saved_ = false;
+      assert((tag_ == Tag::DEF ? this : def_)->slot_ == MAX); // the grammar is frozen
+      p->tok_code = tok;
+      return *this;
+    }
+    Parser& operator=(Parser& rhs)
+    {
+      return operator=(dynamic_cast<BaseParser&>(rhs)); // could never NULL the pointer
+    }
+    Parser& operator=(const Parser& rhs)
+    {
+      return operator=(*own(rhs));
+    }
+    Parser& operator=(BaseParser& rhs)
+    {
+      assert(tag_ == Tag::DEF || tag_ == Tag::NON);
+      Parser *lhs = this;
+      if (tag_ == Tag::NON)
+      {
+        lhs = def_;
+        if (lhs->in_ == NULL)
+          lhs->in_ = in_;
+        else
+          assert(lhs->in_ == in_); // must use same input arg
+        if (lhs->out_ == NULL)
+          lhs->out_ = out_;
+        else
+          assert(lhs->out_ == out_); // must use same output arg
+      }
+      assert(lhs->slot_ == MAX); // the grammar is frozen
+      lhs->arg_.push_back(&rhs);
+      lhs->saved_ = false;
+      return *this;
+    }
+    Parser& operator=(const BaseParser& rhs)
+    {
+      return operator=(*own(rhs));
+    }
+    
+    // parsing engine
+    bool parse(Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      begin();
+      if (pos && !tokens->has_pos(*pos))
+        return false;
+      size_t p = 0;
+      if (tree)
+        tree->clear();
+      return parse(pos ? *pos : p, tokens, tree);
+    }
+    /// parse with the state of the parse kept in ctx, see context.h
+    bool parse(Context& ctx, Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      Context::Use use(ctx);
+      return parse(tokens, pos, tree);
+    }
+    /// parse and return the result with the farthest position at which a token did not match and the tokens expected there
+    Result parse_result(Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      size_t p = 0;
+      if (pos == NULL)
+        pos = &p;
+      size_t start = *pos;
+      bool ok = parse(tokens, pos, tree);
+      if (!ok)
+        *pos = start;
+      return result(ok, *pos);
+    }
+    /// parse_result() with the state of the parse kept in ctx, see context.h
+    Result parse_result(Context& ctx, Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      Context::Use use(ctx);
+      return parse_result(tokens, pos, tree);
+    }
+    virtual bool parse(size_t & pos, Tokenizer *tokens, ParseTree *tree = NULL)
+    {
+      if (tag_ == Tag::DEF)
+      {
+        PROFILE_ENTER(this);
+        State& state = this->state();
+        // reuse the result of a previous parse of this definition at pos
+        if (memo_max_ > 0)
+        {
+          const Memo *m = recall(state, pos, tree != NULL);
+          if (m)
+          {
+            pos = m->end;
+            reached(m->reach);
+            if (out_)
+              *out_ = m->out;
+            if (tree && m->ok)
+              tree->push(m->sub);
+            PROFILE_LEAVE(m->ok, true, 0);
+            return m->ok;
+          }
+        }
+        // left recursion: this definition is parsed again at the position of its innermost parse
+        Call *inner = state.call;
+        if (inner && inner->pos == pos)
+        {
+          inner->recursed = true;
+          if (seeded() > inner->depth)
+            seeded() = inner->depth;
+          PROFILE_LEAVE(inner->seed != NULL, false, 0);
+          if (inner->seed == NULL)
+            return false;
+          pos = inner->seed->end;
+          if (out_)
+            *out_ = inner->seed->out;
+          if (tree)
+            tree->push(inner->seed->sub);
+          return true;
+        }
+        if (depth() >= limit())
+          throw Exceeded();
+        size_t p = pos;
+        InType in = InType();
+        if (memo_max_ > 0 && in_)
+          in = *in_;
+        Call call = { p, ++depth(), false, NULL };
+        size_t reach = this->reach();
+        this->reach() = p;
+        // parse nonterminal definitions (w/o in/out)
+        save_flow();
+        Active active(this, state, &call);
+        bool ok = define(p, pos, tokens, tree);
+        if (ok && call.recursed)
+        {
+          // grow the seed parse of the left recursion until it no longer extends
+          Memo seed;
+          seed.end = pos;
+          if (out_)
+            seed.out = *out_;
+          if (tree)
+            seed.sub = tree->pop();
+          call.seed = &seed;
+          while (true)
+          {
+            ParseTree::Mark m;
+            if (tree)
+              m = tree->mark();
+            if (!define(p, pos, tokens, tree) || pos <= seed.end)
+            {
+              if (tree)
+                tree->release(m);
+              break;
+            }
+            seed.end = pos;
+            if (out_)
+              seed.out = *out_;
+            if (tree)
+              seed.sub = tree->pop();
+          }
+          pos = seed.end;
+          if (out_)
+            *out_ = seed.out;
+          if (tree)
+            tree->push(seed.sub);
+        }
+        active.leave();
+        reached(pos);
+        std::swap(reach, this->reach());
+        reached(reach);
+        // results that depend on the seed of an enclosing left recursion are not final
+        bool final = seeded() >= call.depth;
+        if (final)
+          seeded() = MAX;
+        if (memo_max_ > 0 && final)
+          memorize(state, p, in, ok, pos, reach, tree);
+        PROFILE_LEAVE(ok, false, ok ? 0 : reach - p);
+        return ok;
+      }
+      if (tag_ == Tag::NON)
+      {
+        // parse nonterminal w/ in/out
+        assert(def_ != NULL);
+        assert(def_->in_ || def_->out_); // this is a NON, not a DEF that has no IO
+        assert(!def_->in_ || in_); // no input arg, when one is required, parhaps default initialize input?
+        InType tmpi = InType();
+        OutType tmpo = OutType();
+        swap_in(tmpi, tmpo);
+        bool ok = def_->parse(pos, tokens, tree);
+        swap_out(tmpi, tmpo);
+        return ok;
+      }
+      if (tag_ == Tag::TOK)
+      {
+        if (tokens->has_pos(pos))
+        if (tokens->has_pos(pos) && matches(tokens->code(pos)))
+        {
+          if (out_)
+          {
+            TokenStream<InType> tok_stream(tokens, pos, in_);
+            try
+            {
+              tok_stream >> *out_;
+            } catch (extraction_error&) { return false; }
+          }
+          if (tree)
+          {
+            tree->push_token(tokens, pos);
+          }
+          ++pos;
+          return true;
+        }
+        expect(pos, this);
+        return false; 
+      }
+      return BaseParser::parse(pos, tokens, tree);
+    }
+
+  protected:
+    // memoized result of parsing a definition at a position
+    struct Memo
+    {
+      bool      ok;    // parse succeeded
+      bool      tree;  // parse produced sub
+      size_t    end;   // position after the parse
+      size_t    reach; // position after the last token the parse looked at
+      InType    in;    // in-flow value the parse started with
+      OutType   out;   // out-flow value the parse produced
+      size_t    sub;   // node of the subtree the parse produced
+    };
+    // active parse of a definition, to detect and grow left recursion
+    struct Call
+    {
+      size_t pos;      // position of the parse
+      size_t depth;    // number of active definition parses, including this one
+      bool   recursed; // definition was parsed again at pos
+      Memo  *seed;     // result of the definition at pos while growing the seed, or NULL
+    };
+    // flow values saved by the parses of a NON or TOK with flow variables
+    struct Flow : Context::Slot
+    {
+      std::vector<OutType>                    stk; // saved values of out_
+      std::vector<std::pair<InType,OutType> > tmp; // saved flow values of active NON calls made by a Program
+    };
+    // state of the parses of a definition
+    struct State : Context::Slot
+    {
+      State()
+        :
+          memo_gen(0),
+          call(NULL)
+      { }
+      size_t                memo_gen; // value of parses() when memo was filled
+      std::map<size_t,Memo> memo;     // memoized results by position
+      Call                 *call;     // innermost active parse of this definition, or NULL
+    };
+    // parse of a definition in progress, which restores the state of the enclosing parse when it ends, also when it throws
+    class Active
+    {
+      public:
+        Active(Parser *def, State& state, Call *call)
+          :
+            def_(def),
+            state_(state),
+            outer_(state.call)
+        {
+          state.call = call;
+        }
+        ~Active()
+        {
+          leave();
+        }
+        void leave()
+        {
+          if (def_ == NULL)
+            return;
+          def_->restore_flow();
+          state_.call = outer_;
+          --depth();
+          def_ = NULL;
+        }
+      protected:
+        Parser *def_;   // definition parsed, NULL when left
+        State&  state_; // state of the definition
+        Call   *outer_; // enclosing parse of the definition, or NULL
+    };
+
+    // constructors
+    Parser(
+        Parser  *def,
+        InType  *in,
+        OutType *out)
+      :
+        BaseParser(Tag::NON),
+        def_(def),
+        tok_(NULL),
+        in_(in),
+        out_(out),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    { }
+    Parser(
+        Parser      *tok,
+        int         code,
+        InType      *in,
+        OutType     *out)
+      :
+        BaseParser(code),
+        def_(NULL),
+        tok_(tok),
+        in_(in),
+        out_(out),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    { }
+    explicit Parser(Tag tag)
+      :
+        BaseParser(tag),
+        def_(NULL),
+        tok_(NULL),
+        in_(NULL),
+        out_(NULL),
+        memo_max_(0),
+        slot_(MAX),
+        saved_(false)
+    { }
+
+    // helper functions
+    using BaseParser::clone;
+    virtual BaseParser *clone() const
+    {
+      Parser *p = new Parser(*this);
+      p->slot_ = MAX; // the slot remains this node's
+      return p;
+    }
+    // parse the alternatives of this definition from p
+    bool define(size_t p, size_t& pos, Tokenizer *tokens, ParseTree *tree)
+    {
+      size_t n = tree ? tree->mark().stack : 0;
+      for (auto a : arg_)
+      {
+        pos = p;
+        if (a->parse(pos, tokens, tree))
+        {
+          if (tree)
+            tree->wrap(this, n); // the subtrees of the alternative become the children of this node
+          return true;
+        }
+      }
+      return false;
+    }
+    // pass the in/out-flow of this NON to its definition, saving the definition's values in tmpi and tmpo
+    void swap_in(InType& tmpi, OutType& tmpo)
+    {
+      if ((void*)def_->in_ == (void*)def_->out_ &&
+          typeid(def_->in_) == typeid(def_->out_)) // formal in == out
+      {
+        if (def_->out_ != out_)
+          std::swap(tmpo, *def_->out_);
+        if (def_->in_ != in_)
+        {
+          std::swap(*def_->in_, *in_);
+        }
+      }
+      else
+      {
+        if (def_->in_ && def_->in_ != in_)
+        {
+          std::swap(tmpi, *def_->in_);
+          std::swap(*def_->in_, *in_);
+        }
+        if (def_->out_ && def_->out_ != out_)
+          std::swap(tmpo, *def_->out_);
+      }
+    }
+    // pass the out-flow of the definition back to this NON, restoring the definition's values from tmpi and tmpo
+    void swap_out(InType& tmpi, OutType& tmpo)
+    {
+      if (((void*)def_->in_ != (void*)def_->out_ ||
+          typeid(def_->in_) != typeid(def_->out_)) &&
+          def_->in_ && def_->in_ != in_)
+      {
+        std::swap(*in_, *def_->in_);
+        std::swap(*def_->in_, tmpi);
+      }
+      if (def_->out_ && def_->out_ != out_)
+      {
+        if (out_)
+          std::swap(*out_, *def_->out_);
+        std::swap(*def_->out_,  tmpo);
+      }
+    }
+    virtual void frozen()
+    {
+      if (tag_ == Tag::DEF && slot_ == MAX)
+      {
+        // compute the lazy state that parses would otherwise compute
+        saves_.clear();
+        BaseParser::saves(out_, saves_);
+        saved_ = true;
+        state_ = State();
+        slot_ = Context::allocate();
+      }
+      else if ((tag_ == Tag::NON || tag_ == Tag::TOK) && (in_ || out_) && slot_ == MAX)
+      {
+        flow_ = Flow();
+        slot_ = Context::allocate();
+      }
+    }
+    virtual void edited(size_t last, size_t from, size_t to, size_t size)
+    {
+      if (tag_ != Tag::DEF || memo_max_ == 0)
+        return;
+      // keep the results of the last parse that did not look at the tokens from up to to, moving those after them
+      State& state = this->state();
+      std::map<size_t,Memo> memo;
+      if (state.memo_gen == last)
+      {
+        for (auto& m : state.memo)
+        {
+          if (m.second.reach <= from)
+          {
+            memo.insert(memo.end(), m);
+          }
+          else if (m.first >= to)
+          {
+            Memo e = m.second;
+            e.end = e.end - to + from + size;
+            e.reach = e.reach - to + from + size;
+            memo.insert(memo.end(), std::make_pair(m.first - to + from + size, e));
+          }
+        }
+      }
+      state.memo.swap(memo);
+      state.memo_gen = parses();
+    }
+    virtual void enter()
+    {
+      if (tag_ == Tag::DEF)
+      {
+        save_flow();
+      }
+      else if (tag_ == Tag::NON)
+      {
+        Flow& flow = this->flow();
+        flow.tmp.emplace_back();
+        swap_in(flow.tmp.back().first, flow.tmp.back().second);
+      }
+    }
+    virtual void leave()
+    {
+      if (tag_ == Tag::DEF)
+      {
+        restore_flow();
+      }
+      else if (tag_ == Tag::NON)
+      {
+        Flow& flow = this->flow();
+        swap_out(flow.tmp.back().first, flow.tmp.back().second);
+        flow.tmp.pop_back();
+      }
+    }
+    // returns the state of this definition, kept in the current Context when the grammar is frozen
+    State& state()
+    {
+      return slot_ == MAX ? state_ : Context::current()->slot<State>(slot_);
+    }
+    // returns the saved flow values of this NON or TOK, kept in the current Context when the grammar is frozen
+    Flow& flow()
+    {
+      return slot_ == MAX ? flow_ : Context::current()->slot<Flow>(slot_);
+    }
+    // returns the memoized result of parsing at pos (with a subtree if tree is true), or NULL
+    const Memo *recall(State& state, size_t pos, bool tree)
+    {
+      if (state.memo_gen != parses())
+      {
+        state.memo.clear();
+        state.memo_gen = parses();
+      }
+      auto m = state.memo.find(pos);
+      if (m == state.memo.end() || (tree && !m->second.tree) || (in_ && !flow_equal(m->second.in, *in_, 0)))
+        return NULL;
+      return &m->second;
+    }
+    // memoize the result of parsing from pos to end, looking at the tokens up to reach, with in-flow value in
+    void memorize(State& state, size_t pos, const InType& in, bool ok, size_t end, size_t reach, ParseTree *tree)
+    {
+      if (state.memo_gen != parses())
+      {
+        state.memo.clear();
+        state.memo_gen = parses();
+      }
+      auto m = state.memo.find(pos);
+      if (m == state.memo.end())
+      {
+        if (state.memo.size() >= memo_max_)
+          state.memo.erase(state.memo.begin()); // evict the result at the lowest position
+        m = state.memo.insert(std::make_pair(pos, Memo())).first;
+      }
+      m->second.ok = ok;
+      m->second.tree = tree != NULL;
+      m->second.end = end;
+      m->second.reach = reach;
+      m->second.in = in;
+      if (out_)
+        m->second.out = *out_;
+      if (tree && ok)
+        m->second.sub = tree->share();
+    }
+    // compares flow values with ==, or never equal when the type has no ==
+    template<typename T>
+    static auto flow_equal(const T& a, const T& b, int) -> decltype(static_cast<bool>(a == b))
+    {
+      return a == b;
+    }
+    template<typename T>
+    static bool flow_equal(const T&, const T&, long)
+    {
+      return false;
+    }
+    virtual void saves(void *except, std::vector<BaseParser*>& nodes)
+    {
+      if (tag_ == Tag::NON || tag_ == Tag::TOK)
+      {
+        if (out_ && out_ != except)
+        {
+          for (auto n : nodes)
+            if (n->get_out() == out_ && typeid(*n) == typeid(*this))
+              return;
+          nodes.push_back(this);
+        }
+      }
+    }
+    virtual void save()
+    {
+      flow().stk.push_back(*out_);
+    }
+    virtual void restore()
+    {
+      Flow& flow = this->flow();
+      *out_ = std::move(flow.stk.back());
+      flow.stk.pop_back();
+    }
+    // save the out-flow variables this definition's body may update, except its own
+    void save_flow()
+    {
+      if (!saved_)
+      {
+        saves_.clear();
+        BaseParser::saves(out_, saves_);
+        saved_ = true;
+      }
+      for (auto n : saves_)
+        n->save();
+    }
+    // restore the out-flow variables saved by save_flow()
+    void restore_flow()
+    {
+      for (auto n = saves_.rbegin(); n != saves_.rend(); ++n)
+        (*n)->restore();
+    }
+
+    // member data
+    Parser             *def_;
+    Parser             *tok_;
+    InType             *in_;
+    OutType            *out_;
+    Flow                flow_;     // saved flow values of the parses of this NON or TOK, unless frozen
+    size_t              memo_max_; // max number of memoized results, 0 if not memoized
+    State               state_;    // state of the parses of this definition, unless frozen
+    size_t              slot_;     // slot of state_ or flow_ in a Context when frozen, MAX if not frozen
+    std::vector<BaseParser*> saves_; // nodes of the out-flow variables that parses of this definition save
+    bool                saved_;    // saves_ is computed
+};
+
+// allows Token('a') and Token(15) syntax
+typedef BaseParser Token;
+#endif
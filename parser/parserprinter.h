@@ -28,14 +28,15 @@ class ParserPrinter
     void print(const ParseTree * tree)
     {
       if (tree->has_parent())
-        print_tree(tree,0);
+        print_tree(tree->get_root(),0);
     }
 
     std::string graphviz(const ParseTree * tree) 
     {
       std::string result;
       result = "strict graph {\n";
-      result += print_graphviz(tree);
+      if (tree->has_parent())
+        result += print_graphviz(tree->get_root());
       result += "}";
       return result;
     } 
@@ -58,10 +59,10 @@ class ParserPrinter
       bool alt;
       if (arg->arg_.size() == 1 && arg->arg_[0]->tag_ == BaseParser::Tag::ALT)
       {
-        args = arg->arg_[0]->arg_;
+        args.assign(arg->arg_[0]->arg_.begin(), arg->arg_[0]->arg_.end());
         alt = true;
       } else {
-        args = arg->arg_;
+        args.assign(arg->arg_.begin(), arg->arg_.end());
         alt = false;
       }
 
@@ -122,6 +123,19 @@ class ParserPrinter
         case BaseParser::Tag::TOK:
           if (!names_[arg->get_tok()].empty())
             std::cout << names_[arg->get_tok()];
+          else if (arg->set_)
+          {
+            const char *sep = "[";
+            for (auto c : arg->set_->codes())
+            {
+              if (!isprint(c))
+                std::cout << sep << "(" << c << ")";
+              else
+                std::cout << sep << "'" << (char) c << "'";
+              sep = " ";
+            }
+            std::cout << "]";
+          }
           else if (!isprint(arg->get_tok_code()))
             std::cout << "(" << arg->get_tok_code() << ")";
           else
@@ -171,55 +185,55 @@ class ParserPrinter
       }
     }
 
-    std::string print_graphviz(const ParseTree * tree)
+    std::string print_graphviz(const ParseTree::Node& tree)
     {
       std::string result;
       
-      if (names_[tree->get_def()].empty())
-        names_[tree->get_def()] = generate_id(tree->get_def(), 65); 
-      result += "\t" + generate_id(tree, 65) + " [label=" + names_[tree->get_def()] + "];\n";
+      if (names_[tree.get_def()].empty())
+        names_[tree.get_def()] = generate_id(tree.get_def(), 65); 
+      result += "\t" + generate_id(tree.get_id(), 65) + " [label=" + names_[tree.get_def()] + "];\n";
 
-      if (tree->get_name()->empty())
+      if (tree.get_name().empty())
       {
-        result += "\t" + generate_id(tree, 65) + " -- { ";
-        for (auto const &x : *tree->get_children())
-          if (!x.get_name()->empty())
+        result += "\t" + generate_id(tree.get_id(), 65) + " -- { ";
+        for (auto const &x : tree.get_children())
+          if (!x.get_name().empty())
           {
-            long temp_pointer = (long) x.get_name();
+            long temp_pointer = (long) x.get_id();
             std::string id_temp;
             id_temp = static_cast<char>(temp_pointer % 26 + 65);
             id_temp += static_cast<char>(temp_pointer / 10 % 26 + 65);
             id_temp += static_cast<char>(temp_pointer / 260 % 26 + 65);
-            result += id_temp + " [label=" + "\"" + *x.get_name() + "\"] ";
+            result += id_temp + " [label=" + "\"" + x.get_name().str() + "\"] ";
           }
           else
           {
-              result += generate_id(&x, 65) + " ";
+              result += generate_id(x.get_id(), 65) + " ";
           }
         result += "};\n";
       }
-      for (auto const &x : *tree->get_children())
-        if (x.get_name()->empty())
-          result += print_graphviz(&x);
+      for (auto const &x : tree.get_children())
+        if (x.get_name().empty())
+          result += print_graphviz(x);
       return result;
     }
 
-    void print_tree(const ParseTree * tree, int depth) const 
+    void print_tree(const ParseTree::Node& tree, int depth) const 
     {
-      if (!tree->get_name()->empty())
+      if (!tree.get_name().empty())
       {
         std::cout << "\n";
 
         for (int x = 0; x < depth; x++)
           std::cout << "\t";
         std::cout << "{ ";
-        std::cout << *tree->get_name();
+        std::cout << tree.get_name();
         std::cout << " }";
         
-        for (auto child : *tree->get_children())
-          print_tree(&child, depth+1);
+        for (auto child : tree.get_children())
+          print_tree(child, depth+1);
       }
-      else if (tree->get_def())
+      else if (tree.get_def())
       {
         std::cout << "\n";
         
@@ -227,13 +241,13 @@ class ParserPrinter
           std::cout << "\t";
         std::cout << "{ ";
         
-        if (names_.find(tree->get_def()) != names_.end())
-          std::cout << names_.at(tree->get_def());
+        if (names_.find(tree.get_def()) != names_.end())
+          std::cout << names_.at(tree.get_def());
         else
-          std::cout << generate_id(tree->get_def(), 65);
+          std::cout << generate_id(tree.get_def(), 65);
         
-        for (auto child : *tree->get_children())
-          print_tree(&child,depth+1);
+        for (auto child : tree.get_children())
+          print_tree(child,depth+1);
         std::cout << "\n";
         
         for (int x = 0; x < depth; x++)
@@ -1,82 +1,313 @@
+//      parsetree.h
+//
+//      ParseTree stores the parse tree built by a parse
+//
+//      ParseTree tree;
+//      start.parse(&tokens, &pos, &tree); // build the tree of a parse
+//      tree.get_def();                    // definition of the root
+//      for (auto child : tree.get_children())
+//        child.get_name();                // lexeme of a token, or empty
+//
+//      The nodes of a tree are kept in arrays that are reused by the next
+//      parse.  A node refers to its token by position and to its children by
+//      a range of an array of node indices, so building a tree copies neither
+//      lexemes nor subtrees, and clear() releases all nodes at once.  The
+//      lexemes of tokens are looked up in the Tokenizer of the parse, which
+//      must outlive the use of the tree.  The arrays are allocated from the
+//      MemoryResource passed to the constructor, by default the current
+//      resource of the thread, see memoryresource.h.
+
 #ifndef PARSETREE
 #define PARSETREE
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
+#include "memoryresource.h"
+#include "tokenizer.h"
 
 // Forward Declare BaseParser class
 class BaseParser;
 
 class ParseTree
 {
+  friend class BaseParser;
+  template<typename,typename> friend class Parser;
+  friend class Program;
+
   public:
-    ParseTree()
-      :
-        name_(""),
-        def_(NULL)
-    { }
-    ParseTree(std::string name)
+    class Children;
+
+    /// a node of a ParseTree, a nonterminal with children or a token
+    class Node
+    {
+      public:
+        Node(const ParseTree *tree, size_t index)
+          :
+            tree_(tree),
+            index_(index)
+        { }
+        /// returns the lexeme of a token, or an empty lexeme for a nonterminal
+        Tokenizer::Lexeme get_name() const
+        {
+          const Data& d = tree_->nodes_[index_];
+          return d.def ? Tokenizer::Lexeme() : tree_->tokens_->at(d.token).text;
+        }
+        /// returns the definition of a nonterminal, or NULL for a token
+        const BaseParser* get_def() const
+        {
+          return tree_->nodes_[index_].def;
+        }
+        /// returns the position of the token of a token node
+        size_t get_pos() const
+        {
+          return tree_->nodes_[index_].token;
+        }
+        bool has_parent() const
+        {
+          return true;
+        }
+        Children get_children() const
+        {
+          const Data& d = tree_->nodes_[index_];
+          return Children(tree_, d.first, d.first + d.count);
+        }
+        /// returns an address that identifies the node
+        const void * get_id() const
+        {
+          return &tree_->nodes_[index_];
+        }
+        void print_tree(int depth = 0) const
+        {
+          for (int i = 0; i < depth; i++)
+            std::cout << "\t";
+          if (get_def())
+            std::cout << "{ " << get_def() << "\n";
+          else
+            std::cout << "{ " << get_name() << "\n";
+          for (auto x : get_children())
+            x.print_tree(depth + 1);
+          for (int i = 0; i < depth; i++)
+            std::cout << "\t";
+          std::cout << "}\n";
+        }
+      protected:
+        const ParseTree *tree_;
+        size_t           index_;
+    };
+
+    /// the children of a node
+    class Children
+    {
+      public:
+        class const_iterator
+        {
+          public:
+            const_iterator(const ParseTree *tree, size_t k)
+              :
+                tree_(tree),
+                k_(k)
+            { }
+            Node operator*() const
+            {
+              return Node(tree_, tree_->kids_[k_]);
+            }
+            const_iterator& operator++()
+            {
+              ++k_;
+              return *this;
+            }
+            bool operator==(const const_iterator& i) const
+            {
+              return k_ == i.k_;
+            }
+            bool operator!=(const const_iterator& i) const
+            {
+              return k_ != i.k_;
+            }
+          protected:
+            const ParseTree *tree_;
+            size_t           k_;
+        };
+        Children(const ParseTree *tree, size_t first, size_t last)
+          :
+            tree_(tree),
+            first_(first),
+            last_(last)
+        { }
+        const_iterator begin() const
+        {
+          return const_iterator(tree_, first_);
+        }
+        const_iterator end() const
+        {
+          return const_iterator(tree_, last_);
+        }
+        size_t size() const
+        {
+          return last_ - first_;
+        }
+        bool empty() const
+        {
+          return first_ == last_;
+        }
+        Node operator[](size_t k) const
+        {
+          return Node(tree_, tree_->kids_[first_ + k]);
+        }
+      protected:
+        const ParseTree *tree_;
+        size_t           first_;
+        size_t           last_;
+    };
+
+    explicit ParseTree(MemoryResource *memory = MemoryResource::current())
       :
-        name_(name),
-        def_(NULL)
+        nodes_(memory),
+        kids_(memory),
+        stack_(memory),
+        tokens_(NULL)
     { }
-    void set_parent(std::string name)
+    /// returns the resource the nodes are allocated from
+    MemoryResource *resource() const
     {
-      name_ = name;
-      def_ = NULL;
+      return nodes_.get_allocator().resource();
     }
-    void set_parent(const BaseParser* arg)
+    /// returns true if the tree has a root
+    bool has_parent() const
     {
-      name_ = "";
-      def_ = arg;
+      return !stack_.empty();
     }
-    const std::string * get_name() const
+    /// returns the root, requires has_parent()
+    Node get_root() const
     {
-      return &name_;
+      return Node(this, stack_.back());
     }
-    const BaseParser* get_def() const
+    Tokenizer::Lexeme get_name() const
     {
-      return def_;
+      return get_root().get_name();
     }
-    bool has_parent() const
+    const BaseParser* get_def() const
     {
-      return def_ ? true : !name_.empty();
+      return get_root().get_def();
     }
-    const std::vector<ParseTree>* get_children() const
+    Children get_children() const
     {
-      return &children_;
+      if (stack_.empty())
+        return Children(this, 0, 0);
+      return get_root().get_children();
     }
-    ParseTree* add_child(ParseTree child)
+    /// returns the number of nodes allocated by the parse, including nodes of failed alternatives kept for memoized results
+    size_t size() const
     {
-      children_.emplace_back(child);
-      return &children_.back();
+      return nodes_.size();
     }
+    /// release all nodes
     void clear()
     {
-      *this = ParseTree();
-    }
-    void clear_children()
-    {
-      children_.clear();
+      nodes_.clear();
+      kids_.clear();
+      stack_.clear();
+      keep_ = Mark();
+      tokens_ = NULL;
     }
     void print_tree(int depth = 0) const
     {
-      for (int i = 0; i < depth; i++)
-        std::cout << "\t";
-      if (!name_.empty())
-        std::cout << "{ " << name_ << "\n";
-      else if (def_)
-        std::cout << "{ " << def_ << "\n";
-      for (auto x : children_)
-        x.print_tree(depth + 1);
-      for (int i = 0; i < depth; i++)
-        std::cout << "\t";
-      std::cout << "}\n";
+      if (has_parent())
+        get_root().print_tree(depth);
     }
+
   protected:
-    std::string name_;
-    const BaseParser* def_;
-    std::vector<ParseTree> children_;
+
+    // node storage
+    struct Data
+    {
+      const BaseParser *def;   // definition of a nonterminal, NULL for a token
+      size_t            token; // position of the token
+      size_t            first; // index of the first child in kids_
+      size_t            count; // number of children
+    };
+
+    // state of a tree under construction
+    struct Mark
+    {
+      Mark()
+        :
+          stack(0),
+          nodes(0),
+          kids(0)
+      { }
+      size_t stack; // size of stack_
+      size_t nodes; // size of nodes_
+      size_t kids;  // size of kids_
+    };
+
+    // construction, used by parsers
+    Mark mark() const
+    {
+      Mark m;
+      m.stack = stack_.size();
+      m.nodes = nodes_.size();
+      m.kids = kids_.size();
+      return m;
+    }
+    // release the subtrees added after mark m, except the nodes kept for memoized results
+    void release(const Mark& m)
+    {
+      stack_.resize(m.stack);
+      nodes_.resize(std::max(m.nodes, keep_.nodes));
+      kids_.resize(std::max(m.kids, keep_.kids));
+    }
+    // add a subtree for the token at pos
+    void push_token(Tokenizer *tokens, size_t pos)
+    {
+      tokens_ = tokens;
+      stack_.push_back(nodes_.size());
+      nodes_.push_back(Data{ NULL, pos, 0, 0 });
+    }
+    // replace the subtrees added since stack size n by a node of def with these subtrees as children
+    void wrap(const BaseParser *def, size_t n)
+    {
+      size_t first = kids_.size();
+      kids_.insert(kids_.end(), stack_.begin() + n, stack_.end());
+      stack_.resize(n);
+      stack_.push_back(nodes_.size());
+      nodes_.push_back(Data{ def, 0, first, kids_.size() - first });
+    }
+    // add an existing subtree, which may be shared
+    void push(size_t node)
+    {
+      stack_.push_back(node);
+    }
+    // remove the last subtree added and return it
+    size_t pop()
+    {
+      size_t node = stack_.back();
+      stack_.pop_back();
+      return node;
+    }
+    // return the last subtree added and keep its nodes when subtrees are released
+    size_t share()
+    {
+      keep_.nodes = nodes_.size();
+      keep_.kids = kids_.size();
+      return stack_.back();
+    }
+    // keep the nodes of the last parse for the memoized results of the next parse, after the tokens from up to to were replaced by size tokens
+    void edit(size_t from, size_t to, size_t size)
+    {
+      for (auto& d : nodes_)
+        if (d.def == NULL && d.token >= to)
+          d.token = d.token - to + from + size;
+      stack_.clear();
+      keep_ = mark();
+    }
+
+    std::vector<Data,Allocator<Data> >     nodes_;  // nodes
+    std::vector<size_t,Allocator<size_t> > kids_;   // children of the nodes, by node index
+    std::vector<size_t,Allocator<size_t> > stack_;  // subtrees under construction, the root when done
+    Mark                                   keep_;   // nodes and kids to keep on release()
+    Tokenizer                             *tokens_; // tokens of the parse
 };
 #endif
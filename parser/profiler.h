@@ -0,0 +1,291 @@
+//      profiler.h
+//
+//      Profiler class measures the parses of the definitions of a grammar
+//
+//      Profiler prof;
+//      prof.name(&expr, "expr");          // name definitions, as with ParserPrinter
+//      {
+//        Profiler::Use use(prof);         // profile the parses of this thread
+//        start.parse(&tokens);
+//      }
+//      prof.report(std::cout);            // table of the definitions
+//      std::ofstream out("parse.folded");
+//      prof.collapsed(out);               // stacks for flamegraph.pl
+//
+//      Compile with -DPARSER_PROFILE to profile.  Without it, Parser::parse()
+//      has no profiling hooks at all and a Profiler records nothing.
+//
+//      For each definition, a Profiler counts its parses, the parses that
+//      succeeded, failed and reused a memoized result, and the tokens looked
+//      at by the parses that failed, which are backtracked over.  It measures
+//      the time of the parses including the definitions they call, counting
+//      only the outermost parse of a recursive definition, and the time
+//      excluding the definitions they call.  It keeps the max nesting depth
+//      of definition parses at which the definition was parsed.
+//
+//      The collapsed stacks list the exclusive time in nanoseconds of each
+//      stack of definition parses, one line per stack, in the format of
+//      flamegraph.pl and speedscope.
+//
+//      A parse that throws, e.g. when an action throws, ends as a failed
+//      parse of each definition it was parsing.
+//
+//      The definitions that a Program compiles into its instructions are not
+//      profiled: only those it leaves to Parser::parse(), i.e. memoized and
+//      left-recursive definitions, are.  Profile the grammar with
+//      Parser::parse() to measure all of its definitions.  Unnamed
+//      definitions are named def1, def2, ... in the order of their first
+//      parse.
+
+#ifndef PROFILER
+#define PROFILER
+
+#include <algorithm> // std::sort()
+#include <chrono>
+#include <cstdint>
+#include <iomanip>   // std::setw()
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>   // std::pair
+#include <vector>
+
+// Forward Declare BaseParser class
+class BaseParser;
+
+class Profiler
+{
+  template<typename,typename> friend class Parser;
+
+  public:
+    /// measures of the parses of a definition
+    struct Stats
+    {
+      Stats()
+        :
+          calls(0),
+          ok(0),
+          fail(0),
+          memo(0),
+          backtracked(0),
+          inclusive(0),
+          exclusive(0),
+          depth(0)
+      { }
+      size_t   calls;       ///< number of parses
+      size_t   ok;          ///< number of parses that succeeded
+      size_t   fail;        ///< number of parses that failed
+      size_t   memo;        ///< number of parses that reused a memoized result
+      size_t   backtracked; ///< number of tokens looked at by the parses that failed
+      uint64_t inclusive;   ///< nanoseconds of the outermost parses, including the definitions they call
+      uint64_t exclusive;   ///< nanoseconds of the parses, excluding the definitions they call
+      size_t   depth;       ///< max nesting depth of definition parses at a parse
+    };
+    /// makes a profiler the profiler of its thread for the lifetime of a Use
+    class Use
+    {
+      public:
+        explicit Use(Profiler& prof)
+          :
+            prev_(current())
+        {
+          current() = &prof;
+        }
+        ~Use()
+        {
+          current() = prev_;
+        }
+      protected:
+        Profiler *prev_;
+    };
+
+    Profiler()
+      :
+        nodes_(1, Node{ 0, NULL, 0 })
+    { }
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    /// name a definition in the report and the collapsed stacks
+    void name(const BaseParser *def, const std::string& name)
+    {
+      names_[def] = name;
+    }
+    /// returns the measures of a definition
+    Stats stats(const BaseParser *def) const
+    {
+      auto r = records_.find(def);
+      return r != records_.end() ? r->second.stats : Stats();
+    }
+    /// forget the measures, keeping the names
+    void clear()
+    {
+      records_.clear();
+      order_.clear();
+      frames_.clear();
+      edges_.clear();
+      nodes_.assign(1, Node{ 0, NULL, 0 });
+    }
+    /// print a table of the definitions, by decreasing exclusive time
+    void report(std::ostream& os) const
+    {
+      std::vector<const BaseParser*> defs(order_);
+      std::sort(defs.begin(), defs.end(), [this](const BaseParser *a, const BaseParser *b) {
+        return records_.at(a).stats.exclusive > records_.at(b).stats.exclusive;
+      });
+      os << std::left << std::setw(20) << "definition" << std::right
+         << std::setw(10) << "calls"
+         << std::setw(10) << "ok"
+         << std::setw(10) << "fail"
+         << std::setw(10) << "memo"
+         << std::setw(12) << "backtracked"
+         << std::setw(12) << "incl ms"
+         << std::setw(12) << "excl ms"
+         << std::setw(7) << "depth" << "\n";
+      for (auto def : defs)
+      {
+        const Stats& s = records_.at(def).stats;
+        os << std::left << std::setw(20) << label(def) << std::right
+           << std::setw(10) << s.calls
+           << std::setw(10) << s.ok
+           << std::setw(10) << s.fail
+           << std::setw(10) << s.memo
+           << std::setw(12) << s.backtracked
+           << std::fixed << std::setprecision(3)
+           << std::setw(12) << s.inclusive / 1e6
+           << std::setw(12) << s.exclusive / 1e6
+           << std::setw(7) << s.depth << "\n";
+      }
+    }
+    /// print the collapsed stacks of definition parses with their exclusive nanoseconds
+    void collapsed(std::ostream& os) const
+    {
+      for (size_t k = 1; k < nodes_.size(); ++k)
+      {
+        if (nodes_[k].self == 0)
+          continue;
+        std::vector<const BaseParser*> stack;
+        for (size_t i = k; i != 0; i = nodes_[i].parent)
+          stack.push_back(nodes_[i].def);
+        for (size_t i = stack.size(); i > 0; --i)
+          os << label(stack[i - 1]) << (i > 1 ? ";" : " ");
+        os << nodes_[k].self << "\n";
+      }
+    }
+
+  protected:
+
+    typedef std::chrono::steady_clock Clock;
+
+    // measures and state of a definition
+    struct Record
+    {
+      Record()
+        :
+          active(0)
+      { }
+      Stats  stats;  // measures
+      size_t active; // number of its parses in progress
+    };
+    // parse in progress
+    struct Frame
+    {
+      const BaseParser  *def;      // definition parsed
+      size_t             node;     // node of the stack in nodes_
+      Clock::time_point  start;    // time the parse started
+      uint64_t           children; // nanoseconds of the definitions called
+    };
+    // node of the tree of stacks, a stack is the path from the root
+    struct Node
+    {
+      size_t             parent; // node of the stack without the definition
+      const BaseParser  *def;    // definition on top of the stack
+      uint64_t           self;   // exclusive nanoseconds of the stack
+    };
+
+    // returns the profiler of this thread, or NULL
+    static Profiler*& current()
+    {
+      static thread_local Profiler *prof = NULL;
+      return prof;
+    }
+    // parse of a definition by Parser::parse(), which ends as failed when the parse throws
+    class Scope
+    {
+      public:
+        explicit Scope(const BaseParser *def)
+          :
+            prof_(current())
+        {
+          if (prof_)
+            prof_->push(def);
+        }
+        ~Scope()
+        {
+          leave(false, false, 0);
+        }
+        // end the parse, with the number of tokens looked at when it failed
+        void leave(bool ok, bool memo, size_t backtracked)
+        {
+          if (prof_ && !prof_->frames_.empty())
+            prof_->pop(ok, memo, backtracked);
+          prof_ = NULL;
+        }
+      protected:
+        Profiler *prof_; // profiler of the thread when the parse started, NULL when ended or not profiled
+    };
+    void push(const BaseParser *def)
+    {
+      Record& r = records_[def];
+      if (r.stats.calls == 0 && r.active == 0)
+        order_.push_back(def);
+      ++r.active;
+      size_t parent = frames_.empty() ? 0 : frames_.back().node;
+      auto e = edges_.insert(std::make_pair(std::make_pair(parent, def), nodes_.size()));
+      if (e.second)
+        nodes_.push_back(Node{ parent, def, 0 });
+      frames_.push_back(Frame{ def, e.first->second, Clock::now(), 0 });
+      if (r.stats.depth < frames_.size())
+        r.stats.depth = frames_.size();
+    }
+    void pop(bool ok, bool memo, size_t backtracked)
+    {
+      const Frame& f = frames_.back();
+      uint64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - f.start).count();
+      uint64_t self = t > f.children ? t - f.children : 0;
+      Record& r = records_[f.def];
+      ++r.stats.calls;
+      if (ok)
+        ++r.stats.ok;
+      else
+        ++r.stats.fail;
+      if (memo)
+        ++r.stats.memo;
+      r.stats.backtracked += backtracked;
+      r.stats.exclusive += self;
+      if (--r.active == 0)
+        r.stats.inclusive += t;
+      nodes_[f.node].self += self;
+      frames_.pop_back();
+      if (!frames_.empty())
+        frames_.back().children += t;
+    }
+    // returns the name of a definition
+    std::string label(const BaseParser *def) const
+    {
+      auto n = names_.find(def);
+      if (n != names_.end())
+        return n->second;
+      size_t k = std::find(order_.begin(), order_.end(), def) - order_.begin();
+      return "def" + std::to_string(k + 1);
+    }
+
+    std::map<const BaseParser*,std::string>              names_;   // names of definitions
+    std::unordered_map<const BaseParser*,Record>         records_; // measures of definitions
+    std::vector<const BaseParser*>                       order_;   // definitions in the order of their first parse
+    std::vector<Frame>                                   frames_;  // parses in progress
+    std::map<std::pair<size_t,const BaseParser*>,size_t> edges_;   // nodes of stacks by parent node and definition
+    std::vector<Node>                                    nodes_;   // tree of stacks, the root is the empty stack
+};
+
+#endif
@@ -0,0 +1,676 @@
+//      program.h
+//
+//      Compiles a grammar into a flat instruction array run by a loop
+//
+//      Program prog(&start);        // compile the grammar of nonterminal start
+//      prog.parse(&tokens);         // same result as start.parse(&tokens)
+//      prog.parse_result(&tokens);  // same Result as start.parse_result(&tokens)
+//
+//      Instead of walking the grammar's node graph with virtual parse() calls,
+//      a Program matches tokens, takes choices, repeats and calls definitions
+//      with jumps in one contiguous instruction array, keeping backtrack
+//      points, call frames and repeat counters on explicit stacks.
+//
+//      Alternations indexed by Analysis::index() dispatch on the current
+//      token's code to their candidate alternatives.  Repeats of a token or
+//      of alternative tokens match the run of their codes at once.
+//
+//      Flow variables and actions behave exactly as with Parser::parse().
+//      Memoized and left-recursive nonterminals are parsed by their
+//      Parser::parse().  Parse trees are the same as those built by
+//      Parser::parse().  Compile the
+//      program after the grammar is complete: later changes to the grammar
+//      are not seen by the program.
+//
+//      Since its stacks are on the heap, a Program parses input nested to any
+//      depth without recursing on the native stack.  To bound the memory used
+//      by deeply nested input, limit the nesting depth of nonterminal calls:
+//
+//      prog.limit(1000);     // parses nesting deeper than 1000 calls fail
+//      prog.exceeded();      // true if the last parse failed on the limit
+//
+//      Memoized and left-recursive nonterminals recurse on the native stack,
+//      as their Parser::parse() does.  The limit counts their nested
+//      definition parses too, so a limited Program also bounds the native
+//      stack used by deeply nested input to such nonterminals.
+//
+//      A Program keeps its stacks between parses, so threads that share a
+//      frozen grammar each compile their own Program and parse with their own
+//      Context, see context.h.
+
+#ifndef PROGRAM
+#define PROGRAM
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "parser.h"
+#include "analysis.h"
+
+class Program
+{
+  public:
+    Program()
+      :
+        start_(NULL),
+        limit_(BaseParser::MAX),
+        exceeded_(false)
+    { }
+    explicit Program(BaseParser *start)
+      :
+        start_(NULL),
+        limit_(BaseParser::MAX),
+        exceeded_(false)
+    {
+      compile(start);
+    }
+    /// compile the grammar of the start nonterminal
+    void compile(BaseParser *start)
+    {
+      assert(start->tag_ == BaseParser::Tag::DEF);
+      start_ = start;
+      code_.clear();
+      switches_.clear();
+      spans_.clear();
+      defs_.clear();
+      calls_.clear();
+      recursive_.clear();
+      Analysis an(start);
+      for (auto def : an.definitions())
+        if (an.left_recursive(def))
+          recursive_.insert(def);
+      call(start);
+      emit(Op::HALT);
+      // compile the definitions called, which may call more definitions
+      for (size_t i = 0; i < calls_.size(); ++i)
+      {
+        BaseParser *def = code_[calls_[i]].node;
+        if (defs_.find(def) == defs_.end())
+        {
+          defs_[def] = code_.size();
+          emit(Op::ENTER, def);
+          alternation(def->arg_);
+          emit(Op::LEAVE);
+          emit(Op::RET, def);
+        }
+      }
+      for (auto i : calls_)
+        code_[i].next = defs_[code_[i].node];
+    }
+    /// limit the nesting depth of nonterminal calls, a parse fails when it exceeds the limit
+    void limit(size_t depth)
+    {
+      limit_ = depth;
+    }
+    /// returns true if the last parse failed because it exceeded the depth limit
+    bool exceeded() const
+    {
+      return exceeded_;
+    }
+    /// number of instructions of the compiled program
+    size_t size() const
+    {
+      return code_.size();
+    }
+    /// parse tokens from position *pos, or from 0 when pos is NULL
+    bool parse(Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      assert(start_ != NULL);
+      BaseParser::begin();
+      if (pos && !tokens->has_pos(*pos))
+        return false;
+      size_t p = pos ? *pos : 0;
+      exceeded_ = false;
+      if (tree)
+        tree->clear();
+      bool ok = false;
+      try
+      {
+        ok = run(p, tokens, tree);
+      }
+      catch (...)
+      {
+        // an action or the tokenizer threw: the next parse must not backtrack into this one
+        unwind();
+        if (tree)
+          tree->clear();
+        throw;
+      }
+      if (!ok)
+      {
+        if (tree)
+          tree->clear();
+        return false;
+      }
+      if (pos)
+        *pos = p;
+      return true;
+    }
+    /// parse and return the result with the farthest position at which a token did not match and the tokens expected there
+    Result parse_result(Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      size_t p = 0;
+      if (pos == NULL)
+        pos = &p;
+      bool ok = parse(tokens, pos, tree);
+      return BaseParser::result(ok, *pos);
+    }
+    /// parse with the state of the parse kept in ctx, see context.h
+    bool parse(Context& ctx, Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      Context::Use use(ctx);
+      return parse(tokens, pos, tree);
+    }
+    /// parse_result() with the state of the parse kept in ctx, see context.h
+    Result parse_result(Context& ctx, Tokenizer *tokens, size_t *pos = NULL, ParseTree *tree = NULL)
+    {
+      Context::Use use(ctx);
+      return parse_result(tokens, pos, tree);
+    }
+
+  protected:
+
+    enum class Op
+    {
+      TOKEN,      // match token with code, or fail
+      SET,        // match token with a code in node's set, or fail
+      LEAF,       // match node with node->parse(), or fail
+      ACTION,     // execute node's action, fail on parsing_error
+      DISPATCH,   // try the alternatives of switch n for the current token
+      CHOICE,     // push backtrack point to next
+      COMMIT,     // pop backtrack point, jump to next
+      BACKCOMMIT, // pop backtrack point and restore its position, jump to next
+      FAILTWICE,  // pop backtrack point, fail
+      FAIL,       // fail
+      JUMP,       // jump to next
+      CALL,       // call definition at next
+      RET,        // return from node's definition
+      ENTER,      // enter node's DEF or NON
+      LEAVE,      // leave the last entered DEF or NON
+      REPEAT,     // push repeat counter
+      NEXT,       // count repeat, jump to next when fewer than n, else pop counter
+      ENOUGH,     // pop repeat counter, fail when fewer than n
+      SPAN,       // match the run of tokens of span n, or fail when too short
+      HALT,       // accept
+    };
+
+    struct Instr
+    {
+      Op          op;   // opcode
+      int         code; // token code of TOKEN
+      size_t      next; // jump target
+      size_t      n;    // max repeats of NEXT, min repeats of ENOUGH, switch of DISPATCH
+      BaseParser *node; // node of LEAF, ACTION, CALL, RET, ENTER, SET, and of TOKEN, SPAN, DISPATCH for Result
+    };
+
+    struct Switch
+    {
+      std::unordered_map<int,std::vector<size_t> > alts;  // alternatives to try for a token code
+      std::vector<size_t>                          other; // alternatives to try for other codes and at the end
+    };
+
+    struct Span
+    {
+      std::vector<int> codes; // token codes to match
+      const TokenSet  *set;   // token set to match when codes is empty
+      size_t           min;   // min number of tokens
+      size_t           max;   // max number of tokens
+    };
+
+    struct Choice
+    {
+      size_t next;   // instruction to backtrack to
+      size_t pos;    // position to backtrack to
+      size_t frames; // number of frames to keep
+      size_t counts; // number of repeat counters to keep
+      ParseTree::Mark mark; // parse tree to keep
+      const std::vector<size_t> *alts; // alternatives of DISPATCH, or NULL
+      size_t k;      // next alternative of DISPATCH to try
+    };
+
+    struct Frame
+    {
+      size_t      ret;  // return address of CALL
+      BaseParser *node; // node of ENTER, NULL for CALL
+      size_t      tree; // number of subtrees before CALL
+    };
+
+    // parsing engine
+    bool run(size_t& pos, Tokenizer *tokens, ParseTree *tree)
+    {
+      // reuse the stacks of the previous parse, which are empty
+      std::vector<Choice>& choices = choices_;
+      std::vector<Frame>& frames = frames_;
+      std::vector<size_t>& counts = counts_;
+      size_t depth = 0; // number of CALL frames
+      size_t pc = 0;
+      while (true)
+      {
+        const Instr& i = code_[pc];
+        switch (i.op)
+        {
+          case Op::TOKEN:
+            if (tokens->has_pos(pos) && tokens->code(pos) == i.code)
+            {
+              if (tree)
+                tree->push_token(tokens, pos);
+              ++pos;
+              ++pc;
+              continue;
+            }
+            BaseParser::expect(pos, i.node);
+            break;
+          case Op::SET:
+            if (tokens->has_pos(pos) && i.node->set_->contains(tokens->code(pos)))
+            {
+              if (tree)
+                tree->push_token(tokens, pos);
+              ++pos;
+              ++pc;
+              continue;
+            }
+            BaseParser::expect(pos, i.node);
+            break;
+          case Op::LEAF:
+          {
+            if (limit_ == BaseParser::MAX)
+            {
+              if (i.node->parse(pos, tokens, tree))
+              {
+                ++pc;
+                continue;
+              }
+              break;
+            }
+            // memoized and left-recursive definitions recurse natively, bound them by the depth left
+            bool ok = false;
+            BaseParser::limit() = limit_ - depth;
+            try
+            {
+              ok = i.node->parse(pos, tokens, tree);
+            }
+            catch (BaseParser::Exceeded&)
+            {
+              // abandon the parse, leaving all DEFs and NONs entered
+              exceeded_ = true;
+              choices.clear();
+            }
+            BaseParser::limit() = BaseParser::MAX;
+            if (ok)
+            {
+              ++pc;
+              continue;
+            }
+            break;
+          }
+          case Op::ACTION:
+            try
+            {
+              i.node->act_();
+            } catch (parsing_error&) { break; }
+            ++pc;
+            continue;
+          case Op::DISPATCH:
+          {
+            const Switch& sw = switches_[i.n];
+            const std::vector<size_t> *alts = &sw.other;
+            BaseParser::expect(pos, i.node);
+            if (tokens->has_pos(pos))
+            {
+              auto j = sw.alts.find(tokens->code(pos));
+              if (j != sw.alts.end())
+                alts = &j->second;
+            }
+            if (alts->empty())
+              break;
+            choices.push_back(Choice{ 0, pos, frames.size(), counts.size(), mark(tree), alts, 1 });
+            pc = alts->front();
+            continue;
+          }
+          case Op::CHOICE:
+            choices.push_back(Choice{ i.next, pos, frames.size(), counts.size(), mark(tree), NULL, 0 });
+            ++pc;
+            continue;
+          case Op::COMMIT:
+            choices.pop_back();
+            pc = i.next;
+            continue;
+          case Op::BACKCOMMIT:
+            pos = choices.back().pos;
+            choices.pop_back();
+            pc = i.next;
+            continue;
+          case Op::FAILTWICE:
+            choices.pop_back();
+            break;
+          case Op::FAIL:
+            break;
+          case Op::JUMP:
+            pc = i.next;
+            continue;
+          case Op::CALL:
+            if (depth >= limit_)
+            {
+              // abandon the parse, leaving all DEFs and NONs entered
+              exceeded_ = true;
+              choices.clear();
+              break;
+            }
+            ++depth;
+            frames.push_back(Frame{ pc + 1, NULL, tree ? tree->mark().stack : 0 });
+            pc = i.next;
+            continue;
+          case Op::RET:
+            if (tree)
+              tree->wrap(i.node, frames.back().tree);
+            --depth;
+            pc = frames.back().ret;
+            frames.pop_back();
+            continue;
+          case Op::ENTER:
+            i.node->enter();
+            frames.push_back(Frame{ 0, i.node, 0 });
+            ++pc;
+            continue;
+          case Op::LEAVE:
+            frames.back().node->leave();
+            frames.pop_back();
+            ++pc;
+            continue;
+          case Op::REPEAT:
+            counts.push_back(0);
+            ++pc;
+            continue;
+          case Op::NEXT:
+            if (++counts.back() < i.n)
+            {
+              pc = i.next;
+            }
+            else
+            {
+              counts.pop_back();
+              ++pc;
+            }
+            continue;
+          case Op::ENOUGH:
+          {
+            size_t k = counts.back();
+            counts.pop_back();
+            if (k < i.n)
+              break;
+            ++pc;
+            continue;
+          }
+          case Op::SPAN:
+          {
+            const Span& s = spans_[i.n];
+            size_t k = s.set ? tokens->span(pos, *s.set, s.max) : tokens->span(pos, s.codes.data(), s.codes.size(), s.max);
+            if (k < s.max)
+              BaseParser::expect(pos + k, i.node);
+            if (k < s.min)
+              break;
+            if (tree)
+              for (size_t j = 0; j < k; ++j)
+                tree->push_token(tokens, pos + j);
+            pos += k;
+            ++pc;
+            continue;
+          }
+          case Op::HALT:
+            choices.clear();
+            return true;
+        }
+        // fail: backtrack to the last choice, leaving the DEFs and NONs entered since
+        while (true)
+        {
+          size_t keep = choices.empty() ? 0 : choices.back().frames;
+          while (frames.size() > keep)
+          {
+            if (frames.back().node)
+              frames.back().node->leave();
+            else
+              --depth;
+            frames.pop_back();
+          }
+          if (choices.empty())
+          {
+            counts.clear();
+            return false;
+          }
+          Choice& c = choices.back();
+          pos = c.pos;
+          counts.resize(c.counts);
+          if (tree)
+            tree->release(c.mark);
+          if (c.alts == NULL)
+          {
+            pc = c.next;
+            choices.pop_back();
+            break;
+          }
+          if (c.k < c.alts->size())
+          {
+            pc = (*c.alts)[c.k++];
+            break;
+          }
+          choices.pop_back(); // no more alternatives of DISPATCH to try
+        }
+      }
+    }
+
+    // leave the DEFs and NONs entered by a parse that did not return, and drop its backtrack points and repeat counters
+    void unwind()
+    {
+      while (!frames_.empty())
+      {
+        if (frames_.back().node)
+          frames_.back().node->leave();
+        frames_.pop_back();
+      }
+      choices_.clear();
+      counts_.clear();
+      BaseParser::limit() = BaseParser::MAX;
+    }
+
+    static ParseTree::Mark mark(const ParseTree *tree)
+    {
+      return tree ? tree->mark() : ParseTree::Mark();
+    }
+
+    // code generation
+    size_t emit(Op op, BaseParser *node = NULL)
+    {
+      code_.push_back(Instr{ op, 0, 0, 0, node });
+      return code_.size() - 1;
+    }
+    void call(BaseParser *def)
+    {
+      if (def->get_memo() > 0 || recursive_.count(def))
+      {
+        emit(Op::LEAF, def);
+      }
+      else
+      {
+        calls_.push_back(emit(Op::CALL, def));
+      }
+    }
+    void node(BaseParser *arg)
+    {
+      switch (arg->tag_)
+      {
+        case BaseParser::Tag::DEF:
+          call(arg);
+          break;
+        case BaseParser::Tag::NON:
+          emit(Op::ENTER, arg);
+          call(const_cast<BaseParser*>(arg->get_def())); // a NON's def is never const
+          emit(Op::LEAVE);
+          break;
+        case BaseParser::Tag::TOK:
+          if (arg->get_out())
+          {
+            emit(Op::LEAF, arg); // extracts the token's value
+          }
+          else if (arg->set_)
+          {
+            emit(Op::SET, arg);
+          }
+          else
+          {
+            code_[emit(Op::TOKEN, arg)].code = arg->tok_code;
+          }
+          break;
+        case BaseParser::Tag::ACT:
+          emit(Op::ACTION, arg);
+          break;
+        case BaseParser::Tag::SEQ:
+        case BaseParser::Tag::ALT:
+          repeat(arg);
+          break;
+      }
+    }
+    void body(BaseParser *arg)
+    {
+      if (arg->tag_ == BaseParser::Tag::SEQ)
+      {
+        for (auto a : arg->arg_)
+          node(a);
+      }
+      else if (arg->idx_)
+      {
+        dispatch(arg);
+      }
+      else
+      {
+        alternation(arg->arg_);
+      }
+    }
+    void dispatch(BaseParser *arg)
+    {
+      size_t d = emit(Op::DISPATCH, arg);
+      std::map<BaseParser*,size_t> blocks;
+      std::vector<size_t> commits;
+      for (auto a : arg->arg_)
+      {
+        blocks[a] = code_.size();
+        node(a);
+        commits.push_back(emit(Op::COMMIT));
+      }
+      for (auto i : commits)
+        code_[i].next = code_.size();
+      Switch sw;
+      for (auto& i : arg->idx_->alts)
+        for (auto a : i.second)
+          sw.alts[i.first].push_back(blocks[a]);
+      for (auto a : arg->idx_->other)
+        sw.other.push_back(blocks[a]);
+      code_[d].n = switches_.size();
+      switches_.push_back(sw);
+    }
+    void alternation(const BaseParser::Nodes& args)
+    {
+      if (args.empty())
+      {
+        emit(Op::FAIL);
+        return;
+      }
+      std::vector<size_t> commits;
+      for (size_t k = 0; k + 1 < args.size(); ++k)
+      {
+        size_t choice = emit(Op::CHOICE);
+        node(args[k]);
+        commits.push_back(emit(Op::COMMIT));
+        code_[choice].next = code_.size();
+      }
+      node(args.back());
+      for (auto i : commits)
+        code_[i].next = code_.size();
+    }
+    void repeat(BaseParser *arg)
+    {
+      size_t min = arg->min_;
+      size_t max = arg->max_;
+      int set[BaseParser::SPAN];
+      size_t n = max > 1 ? arg->span_codes(set) : 0;
+      const TokenSet *s = max > 1 ? arg->span_set() : NULL;
+      if (n > 0 || s != NULL)
+      {
+        // repeat of a token, of alternative tokens or of a token set
+        code_[emit(Op::SPAN, arg)].n = spans_.size();
+        spans_.push_back(Span{ std::vector<int>(set, set + n), s, min, max });
+      }
+      else if (max == 0 && min > 0)
+      {
+        // lookahead ~X
+        size_t choice = emit(Op::CHOICE);
+        body(arg);
+        size_t commit = emit(Op::BACKCOMMIT);
+        size_t fail = emit(Op::FAIL);
+        code_[choice].next = fail;
+        code_[commit].next = code_.size();
+      }
+      else if (max == 0)
+      {
+        // negative lookahead !X
+        size_t choice = emit(Op::CHOICE);
+        body(arg);
+        emit(Op::FAILTWICE);
+        code_[choice].next = code_.size();
+      }
+      else if (min == 1 && max == 1)
+      {
+        // X
+        body(arg);
+      }
+      else if (min == 0 && max == 1)
+      {
+        // optional -X
+        size_t choice = emit(Op::CHOICE);
+        body(arg);
+        size_t commit = emit(Op::COMMIT);
+        code_[commit].next = code_.size();
+        code_[choice].next = code_.size();
+      }
+      else if (min == 0 && max == BaseParser::MAX)
+      {
+        // repeat *X
+        size_t choice = emit(Op::CHOICE);
+        body(arg);
+        code_[emit(Op::COMMIT)].next = choice;
+        code_[choice].next = code_.size();
+      }
+      else
+      {
+        // repeat N-M * X, including +X
+        emit(Op::REPEAT);
+        size_t choice = emit(Op::CHOICE);
+        body(arg);
+        size_t commit = emit(Op::COMMIT);
+        code_[commit].next = code_.size();
+        size_t next = emit(Op::NEXT);
+        code_[next].next = choice;
+        code_[next].n = max;
+        size_t jump = emit(Op::JUMP);
+        size_t enough = emit(Op::ENOUGH);
+        code_[enough].n = min;
+        code_[choice].next = enough;
+        code_[jump].next = code_.size();
+      }
+    }
+
+    BaseParser                  *start_; // start nonterminal
+    size_t                       limit_; // max nesting depth of CALLs
+    bool                         exceeded_; // last parse exceeded limit_
+    std::vector<Instr>           code_;  // instructions
+    std::vector<Switch>          switches_; // alternatives of DISPATCH instructions
+    std::vector<Span>            spans_; // tokens of SPAN instructions
+    std::map<BaseParser*,size_t> defs_;  // address of each compiled definition
+    std::vector<size_t>          calls_; // CALL instructions to link
+    std::set<BaseParser*>        recursive_; // left-recursive definitions
+    std::vector<Choice>          choices_; // backtrack points
+    std::vector<Frame>           frames_; // call frames and DEFs and NONs entered
+    std::vector<size_t>          counts_; // repeat counters
+};
+
+#endif
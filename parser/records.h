@@ -0,0 +1,267 @@
+//      records.h
+//
+//      Records class parses the records of a buffer in parallel
+//
+//      struct Line                     // parses one record at a time
+//      {
+//        typedef int Result;           // result of a record
+//        Line();                       // builds the grammar
+//        Result operator()(const char *begin, const char *end);
+//      };
+//
+//      Records<Line> records;          // a Line per thread
+//      std::vector<int> results = records.parse(data, size, '\n');
+//
+//      The buffer is split into records that end with a delimiter, and the
+//      records are passed to the Workers of a pool of threads.  A record
+//      includes its delimiter, except the last record when the buffer does
+//      not end with a delimiter.  The results are returned in the order of
+//      the records in the buffer.
+//
+//      Each thread constructs its own Worker, so a Worker builds its own
+//      grammar with its own flow variables, and tokenizes and parses records
+//      without sharing any state with the other threads.  A Worker may also
+//      parse with a frozen grammar shared by all Workers, see context.h.
+//
+//      The buffer is divided into blocks of records.  Each thread parses the
+//      blocks of its part of the buffer in order, and when it runs out of
+//      blocks, it steals blocks from the end of the parts of other threads.
+//
+//      An exception thrown by a Worker stops the parse and is rethrown by
+//      parse().
+
+#ifndef RECORDS
+#define RECORDS
+
+#include <algorithm> // std::max(), std::min()
+#include <atomic>
+#include <condition_variable>
+#include <cstring>   // memchr()
+#include <deque>
+#include <exception> // std::exception_ptr
+#include <memory>    // std::unique_ptr
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template<typename Worker>
+class Records
+{
+  public:
+    typedef typename Worker::Result Result; ///< result of a record
+
+    /// start a pool of threads, one per core when threads is 0
+    explicit Records(size_t threads = 0)
+      :
+        gen_(0),
+        idle_(0),
+        stop_(false),
+        failed_(false)
+    {
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      for (size_t i = 0; i < threads; ++i)
+        queues_.emplace_back(new Queue());
+      for (size_t i = 0; i < threads; ++i)
+        threads_.emplace_back(&Records::run, this, i);
+    }
+    Records(const Records&) = delete;
+    Records& operator=(const Records&) = delete;
+    ~Records()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      start_.notify_all();
+      for (auto& t : threads_)
+        t.join();
+    }
+    /// returns the number of threads
+    size_t threads() const
+    {
+      return threads_.size();
+    }
+    /// parse the records of data[0..size-1] ending with delim, returns their results in order
+    std::vector<Result> parse(const char *data, size_t size, char delim = '\n')
+    {
+      split(data, size, delim);
+      std::unique_lock<std::mutex> lock(mutex_);
+      error_ = std::exception_ptr();
+      failed_ = false;
+      idle_ = 0;
+      ++gen_;
+      start_.notify_all();
+      // wait for all threads, so that none is still looking for blocks when the next parse splits its buffer
+      done_.wait(lock, [this]{ return idle_ == threads_.size(); });
+      if (error_)
+        std::rethrow_exception(error_);
+      std::vector<Result> results;
+      size_t n = 0;
+      for (auto& r : results_)
+        n += r.size();
+      results.reserve(n);
+      for (auto& r : results_)
+      {
+        for (auto& x : r)
+          results.push_back(std::move(x));
+        r.clear();
+      }
+      return results;
+    }
+
+  protected:
+
+    static const size_t BLOCKS = 16;    // blocks per thread, to balance the load
+    static const size_t MIN = 4096;     // min size of a block in bytes
+
+    // records of a part of the buffer
+    struct Block
+    {
+      const char *begin;
+      const char *end;
+    };
+    // blocks of a thread, taken from the front by the thread and from the back by thieves
+    struct Queue
+    {
+      std::mutex         mutex;
+      std::deque<size_t> blocks;
+    };
+
+    // divide the buffer into blocks that end with a delimiter and deal consecutive blocks to each thread
+    void split(const char *data, size_t size, char delim)
+    {
+      delim_ = delim;
+      blocks_.clear();
+      size_t n = std::max<size_t>(1, std::min(BLOCKS * threads_.size(), size / MIN));
+      const char *end = data + size;
+      const char *b = data;
+      for (size_t k = 1; k <= n && b < end; ++k)
+      {
+        const char *e = data + size * k / n;
+        if (e < b)
+          e = b;
+        if (e < end)
+        {
+          const char *d = static_cast<const char*>(memchr(e, delim, end - e));
+          e = d ? d + 1 : end;
+        }
+        if (e > b)
+          blocks_.push_back(Block{ b, e });
+        b = e;
+      }
+      for (auto& r : results_)
+        r.clear();
+      results_.resize(blocks_.size());
+      size_t t = queues_.size();
+      for (size_t i = 0; i < t; ++i)
+        for (size_t k = blocks_.size() * i / t; k < blocks_.size() * (i + 1) / t; ++k)
+          queues_[i]->blocks.push_back(k);
+    }
+    // take the next block of thread i, or steal one, returns false when none is left
+    bool next(size_t i, size_t& k)
+    {
+      {
+        Queue& q = *queues_[i];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.blocks.empty())
+        {
+          k = q.blocks.front();
+          q.blocks.pop_front();
+          return true;
+        }
+      }
+      for (size_t j = 1; j < queues_.size(); ++j)
+      {
+        Queue& q = *queues_[(i + j) % queues_.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.blocks.empty())
+        {
+          k = q.blocks.back();
+          q.blocks.pop_back();
+          return true;
+        }
+      }
+      return false;
+    }
+    // parse the records of block k with worker w
+    void parse(Worker *w, size_t k)
+    {
+      std::vector<Result>& results = results_[k];
+      const char *b = blocks_[k].begin;
+      const char *end = blocks_[k].end;
+      try
+      {
+        if (w == NULL)
+          return;
+        while (b < end)
+        {
+          const char *d = static_cast<const char*>(memchr(b, delim_, end - b));
+          const char *e = d ? d + 1 : end;
+          results.push_back((*w)(b, e));
+          b = e;
+        }
+      }
+      catch (...)
+      {
+        fail(std::current_exception());
+      }
+    }
+    // record the first error of a parse
+    void fail(std::exception_ptr error)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = error;
+      failed_ = true;
+    }
+    // thread i of the pool
+    void run(size_t i)
+    {
+      std::unique_ptr<Worker> w;
+      std::exception_ptr error;
+      try
+      {
+        w.reset(new Worker());
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      size_t gen = 0;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          start_.wait(lock, [&]{ return stop_ || gen_ != gen; });
+          if (stop_)
+            return;
+          gen = gen_;
+        }
+        if (error)
+          fail(error);
+        size_t k;
+        while (next(i, k))
+          parse(failed_ ? NULL : w.get(), k);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (++idle_ == threads_.size())
+          done_.notify_all();
+      }
+    }
+
+    std::vector<std::thread>          threads_; // pool
+    std::vector<std::unique_ptr<Queue> > queues_; // blocks of the threads
+    std::vector<Block>                blocks_;  // blocks of the buffer
+    std::vector<std::vector<Result> > results_; // results of the records of the blocks
+    char                              delim_;   // record delimiter
+    std::mutex                        mutex_;   // guards gen_, idle_, stop_, error_
+    std::condition_variable           start_;   // a parse starts or the pool stops
+    std::condition_variable           done_;    // all threads are done with the parse
+    size_t                            gen_;     // number of parses started
+    size_t                            idle_;    // number of threads done with the parse
+    bool                              stop_;    // the pool stops
+    std::exception_ptr                error_;   // first error of the parse
+    std::atomic<bool>                 failed_;  // a Worker failed, skip the remaining records
+};
+
+#endif
@@ -1,66 +1,510 @@
 //      tokenizer.h
 //
-//      Base Tokenizer class defines Token and Tokens types
+//      Base Tokenizer class defines Token and Lexeme types
+//
+//      A Tokenizer stores its tokens in parallel arrays: the token codes in
+//      one dense array that parsers match against, and the lexemes, line and
+//      column numbers in another.  The bytes of the lexemes are copied into
+//      an arena of large chunks, so adding a token does not allocate a string.
+//      A Token returned by at() is a view: its Lexeme text points into the
+//      arena and remains valid until the Tokenizer is cleared or destroyed, or
+//      until its position is committed.  A tokenizer may also refer to the
+//      lexemes in its input text instead of copying them, see emplace_view().
+//
+//      The length, line and column of a lexeme are kept in 32 bits.  Adding a
+//      lexeme of 4 GiB or more throws std::length_error, and line and column
+//      numbers beyond 4294967295 are kept as 4294967295.
+//
+//      Streaming parses keep memory bounded by committing positions that the
+//      parser will never backtrack to, e.g. after each record of a log:
+//
+//      size_t pos = 0;
+//      while (tokens.has_pos(pos) && record.parse(&tokens, &pos))
+//        tokens.commit(pos); // tokens before pos are no longer needed
+//
+//      Positions remain absolute.  Committed tokens are discarded in batches,
+//      and the arena chunks that only hold committed lexemes are recycled, so
+//      memory is proportional to the tokens between the last commit and the
+//      farthest position looked at.  Tokens before the last commit no longer
+//      exist: has_pos() returns false and at() throws for their positions.
+//
+//      To edit a document, replace() a range of its tokens with new tokens,
+//      whose lexemes are copied into the arena, and parse it again with
+//      Parser::reparse().
+//
+//      The arrays and the arena chunks are allocated from the MemoryResource
+//      passed to the constructor, by default the current resource of the
+//      thread, see memoryresource.h.
 
 #ifndef TOKENIZER
 #define TOKENIZER
 
+#include <algorithm> // std::min()
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>   // std::unique_ptr
+#include <stdexcept>
 #include <string>
 #include <vector>
+#include "memoryresource.h"
+#include "tokenset.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 class Tokenizer
 {
   public:
+    /// view of a lexeme in the arena of a Tokenizer
+    class Lexeme
+    {
+      public:
+        Lexeme()
+          :
+            data_(""),
+            size_(0)
+        { }
+        Lexeme(const char *data, size_t size)
+          :
+            data_(data),
+            size_(size)
+        { }
+        const char *data() const
+        {
+          return data_;
+        }
+        /// returns the lexeme as a 0-terminated string, requires a lexeme in the arena, not a view of input text (use str())
+        const char *c_str() const
+        {
+          return data_;
+        }
+        size_t size() const
+        {
+          return size_;
+        }
+        size_t length() const
+        {
+          return size_;
+        }
+        bool empty() const
+        {
+          return size_ == 0;
+        }
+        const char *begin() const
+        {
+          return data_;
+        }
+        const char *end() const
+        {
+          return data_ + size_;
+        }
+        char operator[](size_t i) const
+        {
+          return data_[i];
+        }
+        char back() const
+        {
+          return data_[size_ - 1];
+        }
+        std::string str() const
+        {
+          return std::string(data_, size_);
+        }
+        operator std::string() const
+        {
+          return str();
+        }
+        friend bool operator==(const Lexeme& a, const Lexeme& b)
+        {
+          return a.size_ == b.size_ && memcmp(a.data_, b.data_, a.size_) == 0;
+        }
+        friend bool operator==(const Lexeme& a, const char *b)
+        {
+          return strncmp(a.data_, b, a.size_) == 0 && b[a.size_] == '\0';
+        }
+        friend bool operator==(const Lexeme& a, const std::string& b)
+        {
+          return a == Lexeme(b.c_str(), b.size());
+        }
+        template<typename T>
+        friend bool operator==(const T& a, const Lexeme& b)
+        {
+          return b == a;
+        }
+        friend bool operator!=(const Lexeme& a, const Lexeme& b)
+        {
+          return !(a == b);
+        }
+        template<typename T>
+        friend bool operator!=(const Lexeme& a, const T& b)
+        {
+          return !(a == b);
+        }
+        template<typename T>
+        friend bool operator!=(const T& a, const Lexeme& b)
+        {
+          return !(b == a);
+        }
+        friend std::ostream& operator<<(std::ostream& os, const Lexeme& a)
+        {
+          return os.write(a.data_, a.size_);
+        }
+      protected:
+        const char *data_;
+        size_t      size_;
+    };
+    /// view of a token
     struct Token
     {
-      Token() : code(0)
+      Token() : code(0), lineno(0), columno(0)
       { }
-      Token(int code, const char *text, size_t leng, size_t lineno, size_t columno)
-        : code(code), text(text, leng), lineno(lineno), columno(columno)
+      Token(int code, const Lexeme& text, size_t lineno, size_t columno)
+        : code(code), text(text), lineno(lineno), columno(columno)
       { }
       int         code;    ///< token code
-      std::string text;    ///< token lexeme
+      Lexeme      text;    ///< token lexeme
       size_t      lineno;  ///< line number of lexeme
       size_t      columno; ///< column number of lexeme
     };
-    /// token container
-    typedef std::vector<Token> Tokens;
+    /// kinds of values converted from lexemes and cached by TokenStream
+    enum Kind { NONE, SIGNED, UNSIGNED, NEGATIVE, FLOAT, DOUBLE };
+    /// value converted from a lexeme and cached by TokenStream
+    union Value
+    {
+      long long          i;
+      unsigned long long u;
+      float              f;
+      double             d;
+    };
+    explicit Tokenizer(MemoryResource *memory = MemoryResource::current())
+      :
+        codes_(memory),
+        infos_(memory),
+        values_(memory),
+        chunks_(memory),
+        spare_(memory),
+        base_(0),
+        cut_(0),
+        next_(NULL),
+        left_(0)
+    { }
+    virtual ~Tokenizer()
+    { }
+    /// returns the resource the tokens are allocated from
+    MemoryResource *resource() const
+    {
+      return codes_.get_allocator().resource();
+    }
     /// returns true if there is a token at the given position
     virtual bool has_pos(size_t pos)
     {
-      return pos < size();
+      return pos < size() && pos >= cut_;
+    }
+    /// returns token at the specified position in the token container, throws exception when out of bounds or committed
+    virtual Token at(size_t pos)
+    {
+      if (pos < cut_)
+        throw std::out_of_range("Tokenizer::at: position is committed");
+      const Info& i = infos_.at(pos - base_);
+      return Token(codes_[pos - base_], Lexeme(i.text, i.leng), i.lineno, i.columno);
+    }
+    /// returns the code of the token at the specified position, requires has_pos(pos)
+    int code(size_t pos) const
+    {
+      return codes_[pos - base_];
+    }
+    /// returns the number of consecutive tokens from pos, at most max, whose codes are among the n codes of set
+    size_t span(size_t pos, const int *set, size_t n, size_t max)
+    {
+      size_t k = 0;
+      while (k < max && has_pos(pos + k))
+      {
+        // match the tokens available from pos + k, which has_pos() may have added
+        size_t avail = std::min(size() - (pos + k), max - k);
+        size_t m = match(codes_.data() + (pos + k - base_), avail, set, n);
+        k += m;
+        if (m < avail)
+          break;
+      }
+      return k;
+    }
+    /// returns the number of consecutive tokens from pos, at most max, whose codes are in the set
+    size_t span(size_t pos, const TokenSet& set, size_t max)
+    {
+      size_t k = 0;
+      while (k < max && has_pos(pos + k))
+      {
+        size_t avail = std::min(size() - (pos + k), max - k);
+        const int *codes = codes_.data() + (pos + k - base_);
+        size_t m = 0;
+        while (m < avail && set.contains(codes[m]))
+          ++m;
+        k += m;
+        if (m < avail)
+          break;
+      }
+      return k;
+    }
+    /// returns the kind of value cached for the token at the specified position, requires has_pos(pos)
+    Kind kind(size_t pos) const
+    {
+      return static_cast<Kind>(infos_[pos - base_].kind);
+    }
+    /// returns the value cached for the token at the specified position, requires kind(pos) != NONE
+    const Value& value(size_t pos) const
+    {
+      return values_[pos - base_];
+    }
+    /// cache a value for the token at the specified position, requires has_pos(pos)
+    void cache(size_t pos, Kind kind, const Value& value)
+    {
+      if (values_.size() < codes_.size())
+        values_.resize(codes_.size());
+      values_[pos - base_] = value;
+      infos_[pos - base_].kind = static_cast<unsigned char>(kind);
+    }
+    /// declare that the parser will not backtrack before pos, so the tokens before pos can be discarded
+    void commit(size_t pos)
+    {
+      if (pos <= cut_)
+        return;
+      cut_ = std::min(pos, size());
+      size_t n = cut_ - base_;
+      // discard in batches, so that the arrays are moved at most once per token
+      if (n < CHUNK / 16 || n < codes_.size() / 2)
+        return;
+      codes_.erase(codes_.begin(), codes_.begin() + n);
+      infos_.erase(infos_.begin(), infos_.begin() + n);
+      values_.erase(values_.begin(), values_.begin() + std::min(n, values_.size()));
+      base_ = cut_;
+      // release the chunks that only hold committed lexemes, keeping spare chunks to reuse
+      size_t k = 0;
+      for (size_t i = 0; i < chunks_.size(); ++i)
+      {
+        Chunk& c = chunks_[i];
+        bool current = next_ != NULL && i + 1 == chunks_.size();
+        if (c.last >= cut_ || current)
+        {
+          if (k != i)
+            chunks_[k] = std::move(c);
+          ++k;
+        }
+        else if (c.size == CHUNK && spare_.empty())
+        {
+          spare_.push_back(std::move(c.data));
+        }
+      }
+      chunks_.resize(k);
+      // restart the current chunk when it only holds committed lexemes
+      if (next_ != NULL && chunks_.back().last < cut_)
+      {
+        next_ = chunks_.back().data.get();
+        left_ = CHUNK;
+      }
     }
-    /// returns token at the specified position in the token container, throws exception when out of bounds
-    virtual const Token& at(size_t pos)
+    /// replace the tokens at positions from up to to by the tokens of edit, copying their lexemes, see Parser::reparse()
+    void replace(size_t from, size_t to, const std::vector<Token>& edit)
     {
-      return tokens_.at(pos);
+      if (from < cut_ || from > to || to > size())
+        throw std::out_of_range("Tokenizer::replace: positions are committed or out of bounds");
+      for (auto& t : edit)
+        checked_leng(t.text.size()); // throws before the tokens change
+      size_t k = from - base_;
+      // move the positions of the lexemes after the edit first, since store() records the positions of new lexemes
+      for (auto& c : chunks_)
+        if (c.last >= to)
+          c.last = c.last - to + from + edit.size();
+      std::vector<int> codes;
+      std::vector<Info> infos;
+      codes.reserve(edit.size());
+      infos.reserve(edit.size());
+      for (size_t j = 0; j < edit.size(); ++j)
+      {
+        const Token& t = edit[j];
+        Info i = { store(t.text.data(), t.text.size(), from + j), checked_leng(t.text.size()), saturated(t.lineno), saturated(t.columno), NONE };
+        codes.push_back(t.code);
+        infos.push_back(i);
+      }
+      codes_.erase(codes_.begin() + k, codes_.begin() + (to - base_));
+      codes_.insert(codes_.begin() + k, codes.begin(), codes.end());
+      infos_.erase(infos_.begin() + k, infos_.begin() + (to - base_));
+      infos_.insert(infos_.begin() + k, infos.begin(), infos.end());
+      if (values_.size() > k)
+      {
+        values_.erase(values_.begin() + k, values_.begin() + std::min(to - base_, values_.size()));
+        values_.insert(values_.begin() + k, edit.size(), Value());
+      }
     }
-    /// clear token container
+    /// returns the position of the last commit, tokens before this position no longer exist
+    size_t committed() const
+    {
+      return cut_;
+    }
+    /// clear token container, keeping memory to reuse for the next tokens
     void clear()
     {
-      tokens_.clear();
+      codes_.clear();
+      infos_.clear();
+      values_.clear();
+      for (auto& c : chunks_)
+        if (c.size == CHUNK && spare_.empty())
+          spare_.push_back(std::move(c.data));
+      chunks_.clear();
+      base_ = 0;
+      cut_ = 0;
+      next_ = NULL;
+      left_ = 0;
     }
-    Tokens tokens_; ///< Token container
  protected:
-    /// returns the current size of the token container
+    static const size_t CHUNK = 65536; // size of an arena chunk
+    // returns the number of leading codes[0..size-1] that are among the n codes of set
+    static size_t match(const int *codes, size_t size, const int *set, size_t n)
+    {
+      size_t k = 0;
+#ifdef __SSE2__
+      if (n <= 4)
+      {
+        // compare four codes at a time with the (repeated) codes of the set
+        __m128i s0 = _mm_set1_epi32(set[0]);
+        __m128i s1 = _mm_set1_epi32(set[n > 1 ? 1 : 0]);
+        __m128i s2 = _mm_set1_epi32(set[n > 2 ? 2 : 0]);
+        __m128i s3 = _mm_set1_epi32(set[n > 3 ? 3 : 0]);
+        for (; k + 4 <= size; k += 4)
+        {
+          __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + k));
+          __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(c, s0), _mm_cmpeq_epi32(c, s1)),
+                                    _mm_or_si128(_mm_cmpeq_epi32(c, s2), _mm_cmpeq_epi32(c, s3)));
+          unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(eq)) & 0xFFFF;
+          if (mask != 0)
+            return k + __builtin_ctz(mask) / 4;
+        }
+      }
+#endif
+      for (; k < size; ++k)
+        if (std::find(set, set + n, codes[k]) == set + n)
+          break;
+      return k;
+    }
+    // lexeme, line and column of a token
+    struct Info
+    {
+      const char   *text;    // lexeme in the arena, 0-terminated
+      unsigned      leng;    // length of the lexeme
+      unsigned      lineno;  // line number of lexeme
+      unsigned      columno; // column number of lexeme
+      unsigned char kind;    // Kind of value cached in values_
+    };
+    // returns the length of a lexeme as kept in Info, throws std::length_error when it does not fit
+    static unsigned checked_leng(size_t leng)
+    {
+      if (leng > std::numeric_limits<unsigned>::max())
+        throw std::length_error("Tokenizer: lexeme of 4 GiB or more");
+      return static_cast<unsigned>(leng);
+    }
+    // returns a line or column number as kept in Info, 4294967295 when it does not fit
+    static unsigned saturated(size_t n)
+    {
+      return n > std::numeric_limits<unsigned>::max() ? std::numeric_limits<unsigned>::max() : static_cast<unsigned>(n);
+    }
+    // releases the bytes of an arena chunk to their resource
+    struct Release
+    {
+      MemoryResource *memory; // resource of the bytes
+      size_t          size;   // number of bytes
+      void operator()(char *p) const
+      {
+        memory->deallocate(p, size, 1);
+      }
+    };
+    typedef std::unique_ptr<char[],Release> Bytes;
+    // arena chunk
+    struct Chunk
+    {
+      Bytes  data; // lexemes, 0-terminated
+      size_t size; // size of the chunk
+      size_t last; // position of the last token with a lexeme in this chunk
+    };
+    /// returns the current size of the token container, the position after the last token
     size_t size() const
     {
-      return tokens_.size();
+      return base_ + codes_.size();
     }
     /// add token at the back of the token container
     Tokenizer& push_back(const Token& token)
     {
-      tokens_.push_back(token);
-      return *this;
+      return emplace_back(token.code, token.text.data(), token.text.size(), token.lineno, token.columno);
     }
     /// emplace token at the back of the token container
     Tokenizer& emplace_back(int code, const char *text, size_t leng, size_t lineno, size_t columno)
     {
-      tokens_.emplace_back(code, text, leng, lineno, columno);
+      unsigned n = checked_leng(leng);
+      Info i = { store(text, leng, size()), n, saturated(lineno), saturated(columno), NONE };
+      codes_.push_back(code);
+      infos_.push_back(i);
       return *this;
     }
-  private:
+    /// emplace token at the back of the token container with a lexeme that refers to text, which must outlive the tokens
+    Tokenizer& emplace_view(int code, const char *text, size_t leng, size_t lineno, size_t columno)
+    {
+      Info i = { text, checked_leng(leng), saturated(lineno), saturated(columno), NONE };
+      codes_.push_back(code);
+      infos_.push_back(i);
+      return *this;
+    }
+    // allocate the bytes of an arena chunk
+    Bytes bytes(size_t size)
+    {
+      MemoryResource *memory = resource();
+      return Bytes(static_cast<char*>(memory->allocate(size, 1)), Release{ memory, size });
+    }
+    // copy the lexeme of the token at pos into the arena
+    const char *store(const char *text, size_t leng, size_t pos)
+    {
+      if (leng >= left_)
+      {
+        if (leng >= CHUNK / 4)
+        {
+          // a long lexeme gets a chunk of its own, the current chunk remains in use as the last chunk
+          Chunk c = { bytes(leng + 1), leng + 1, pos };
+          char *s = c.data.get();
+          chunks_.insert(next_ != NULL ? chunks_.end() - 1 : chunks_.end(), std::move(c));
+          memcpy(s, text, leng);
+          s[leng] = '\0';
+          return s;
+        }
+        Chunk c = { Bytes(), CHUNK, pos };
+        if (spare_.empty())
+        {
+          c.data = bytes(CHUNK);
+        }
+        else
+        {
+          c.data = std::move(spare_.back());
+          spare_.pop_back();
+        }
+        next_ = c.data.get();
+        left_ = CHUNK;
+        chunks_.push_back(std::move(c));
+      }
+      chunks_.back().last = std::max(chunks_.back().last, pos);
+      char *s = next_;
+      memcpy(s, text, leng);
+      s[leng] = '\0';
+      next_ += leng + 1;
+      left_ -= leng + 1;
+      return s;
+    }
+
+    std::vector<int,Allocator<int> >     codes_;  // token codes
+    std::vector<Info,Allocator<Info> >   infos_;  // lexemes, lines and columns of tokens
+    std::vector<Value,Allocator<Value> > values_; // values cached by TokenStream, allocated on first use
+    std::vector<Chunk,Allocator<Chunk> > chunks_; // arena of lexemes, the current chunk is the last
+    std::vector<Bytes,Allocator<Bytes> > spare_;  // released chunks to reuse
+    size_t                               base_;   // position of the first token in the arrays
+    size_t                               cut_;    // position of the last commit
+    char                                *next_;   // next free byte of the current chunk, NULL if none
+    size_t                               left_;   // number of free bytes of the current chunk
 };
 
 #endif
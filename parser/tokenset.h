@@ -0,0 +1,85 @@
+//      tokenset.h
+//
+//      TokenSet class is an immutable set of token codes with O(1) lookup
+//
+//      TokenSet digits({ '0', '1' });
+//      digits.contains('1');            // true
+//
+//      Token codes are sparse: negative codes such as -1, character codes and
+//      small integers for named tokens.  A set maps the range of its codes
+//      from the least code to a dense range of bits, and keeps the codes that
+//      are too far from the others to fit in the bits in a sorted array.
+
+#ifndef TOKENSET
+#define TOKENSET
+
+#include <algorithm>        // std::sort(), std::unique(), std::binary_search()
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+class TokenSet
+{
+  public:
+    TokenSet(std::initializer_list<int> codes)
+      :
+        TokenSet(codes.begin(), codes.end())
+    { }
+    template<typename I>
+    TokenSet(I first, I last)
+      :
+        codes_(first, last),
+        lo_(0)
+    {
+      std::sort(codes_.begin(), codes_.end());
+      codes_.erase(std::unique(codes_.begin(), codes_.end()), codes_.end());
+      if (codes_.empty())
+        return;
+      lo_ = codes_.front();
+      for (auto c : codes_)
+      {
+        size_t k = offset(c);
+        if (k >= DENSE)
+        {
+          far_.push_back(c);
+          continue;
+        }
+        if (k / 64 >= bits_.size())
+          bits_.resize(k / 64 + 1, 0);
+        bits_[k / 64] |= static_cast<uint64_t>(1) << (k % 64);
+      }
+    }
+    /// returns true if the set contains the code
+    bool contains(int code) const
+    {
+      size_t k = offset(code);
+      if (k < 64 * bits_.size())
+        return (bits_[k / 64] >> (k % 64)) & 1;
+      return !far_.empty() && std::binary_search(far_.begin(), far_.end(), code);
+    }
+    /// returns the codes of the set in increasing order
+    const std::vector<int>& codes() const
+    {
+      return codes_;
+    }
+    size_t size() const
+    {
+      return codes_.size();
+    }
+
+  protected:
+    static const size_t DENSE = 4096; // max number of bits
+
+    // returns the dense index of a code, or a large index when the code is less than lo_
+    size_t offset(int code) const
+    {
+      return static_cast<size_t>(static_cast<int64_t>(code) - lo_);
+    }
+
+    std::vector<int>      codes_; // codes, sorted
+    std::vector<uint64_t> bits_;  // codes lo_ + k in bit k
+    std::vector<int>      far_;   // codes not in bits_, sorted
+    int64_t               lo_;    // least code
+};
+
+#endif
@@ -3,12 +3,33 @@
 //    Base class for TokenStream objects
 //
 //    Allows flow variables to be a custom object
+//
+//    A terminal with an out-flow variable extracts the value of its token
+//    with operator>>(TokenStream<InType>&, OutType&).  Overload this operator
+//    to extract custom values, see examples/dcg/dcg.cpp.
+//
+//    The default operator>> converts the lexeme to (unsigned) short, int,
+//    long, long long, float and double values directly, without a stream,
+//    and caches the value in the Tokenizer, so the lexeme is converted only
+//    once when the parser backtracks over the token.  Other types are
+//    extracted with a std::istringstream.
+//
+//    Floats and doubles are converted in the "C" locale, whatever the locale
+//    set with setlocale(), so the radix character of a lexeme is always '.'.
 
 #ifndef TOKENSTREAM
 #define TOKENSTREAM
 
+#include <cstdlib>     // strtof_l(), strtod_l()
+#include <cstring>     // memcpy()
+#include <limits>
 #include <string>
 #include <sstream>
+#include <locale.h>    // newlocale()
+#ifdef __APPLE__
+#include <xlocale.h>   // strtof_l(), strtod_l()
+#endif
+#include "tokenizer.h"
 
 class extraction_error : public std::logic_error {
 public:
@@ -26,14 +47,37 @@ class TokenStream
     TokenStream(int tok_code, std::string text, InType *in)
       :
         code_(tok_code),
-        text_(text),
+        copy_(text),
+        copied_(true),
+        text_(copy_.c_str(), copy_.size()),
+        tokens_(NULL),
+        pos_(0),
+        in_(in)
+    { }
+    TokenStream(Tokenizer *tokens, size_t pos, InType *in)
+      :
+        code_(tokens->code(pos)),
+        copied_(false),
+        text_(tokens->at(pos).text),
+        tokens_(tokens),
+        pos_(pos),
         in_(in)
     { }
     int get_code() const
     {
       return code_;
     }
-    std::string get_text() const
+    const std::string& get_text() const
+    {
+      if (!copied_)
+      {
+        copy_ = text_.str();
+        copied_ = true;
+      }
+      return copy_;
+    }
+    /// returns the lexeme without copying it
+    const Tokenizer::Lexeme& get_lexeme() const
     {
       return text_;
     }
@@ -44,13 +88,197 @@ class TokenStream
     template <typename OutType>
     friend TokenStream<InType>& operator>>(TokenStream<InType>& in, OutType& out)
     {
-      std::istringstream(in.text_) >> out;
+      in.extract(out);
       return in;
     }
   private:
-    int           code_;
-    std::string   text_;
-    InType       *in_;
+    template <typename OutType>
+    void extract(OutType& out)
+    {
+      std::istringstream(get_text()) >> out;
+    }
+    void extract(short& out)
+    {
+      out = clamp<short>(signed_value());
+    }
+    void extract(int& out)
+    {
+      out = clamp<int>(signed_value());
+    }
+    void extract(long& out)
+    {
+      out = clamp<long>(signed_value());
+    }
+    void extract(long long& out)
+    {
+      out = signed_value();
+    }
+    void extract(unsigned short& out)
+    {
+      out = unsigned_value<unsigned short>();
+    }
+    void extract(unsigned int& out)
+    {
+      out = unsigned_value<unsigned int>();
+    }
+    void extract(unsigned long& out)
+    {
+      out = unsigned_value<unsigned long>();
+    }
+    void extract(unsigned long long& out)
+    {
+      out = unsigned_value<unsigned long long>();
+    }
+    void extract(float& out)
+    {
+      if (tokens_ == NULL)
+      {
+        out = to_float<float>(text_);
+        return;
+      }
+      if (tokens_->kind(pos_) != Tokenizer::FLOAT)
+      {
+        Tokenizer::Value v;
+        v.f = to_float<float>(text_);
+        tokens_->cache(pos_, Tokenizer::FLOAT, v);
+      }
+      out = tokens_->value(pos_).f;
+    }
+    void extract(double& out)
+    {
+      if (tokens_ == NULL)
+      {
+        out = to_float<double>(text_);
+        return;
+      }
+      if (tokens_->kind(pos_) != Tokenizer::DOUBLE)
+      {
+        Tokenizer::Value v;
+        v.d = to_float<double>(text_);
+        tokens_->cache(pos_, Tokenizer::DOUBLE, v);
+      }
+      out = tokens_->value(pos_).d;
+    }
+    long long signed_value()
+    {
+      if (tokens_ == NULL)
+        return to_signed(text_);
+      if (tokens_->kind(pos_) != Tokenizer::SIGNED)
+      {
+        Tokenizer::Value v;
+        v.i = to_signed(text_);
+        tokens_->cache(pos_, Tokenizer::SIGNED, v);
+      }
+      return tokens_->value(pos_).i;
+    }
+    // a negative value is negated in T, a magnitude out of the range of T is clamped, as std::istream does
+    template <typename T>
+    T unsigned_value()
+    {
+      bool neg;
+      unsigned long long v;
+      if (tokens_ == NULL)
+      {
+        v = to_unsigned(text_, neg);
+      }
+      else
+      {
+        Tokenizer::Kind kind = tokens_->kind(pos_);
+        if (kind != Tokenizer::UNSIGNED && kind != Tokenizer::NEGATIVE)
+        {
+          Tokenizer::Value u;
+          u.u = to_unsigned(text_, neg);
+          kind = neg ? Tokenizer::NEGATIVE : Tokenizer::UNSIGNED;
+          tokens_->cache(pos_, kind, u);
+        }
+        v = tokens_->value(pos_).u;
+        neg = kind == Tokenizer::NEGATIVE;
+      }
+      if (v > std::numeric_limits<T>::max())
+        return std::numeric_limits<T>::max();
+      return neg ? static_cast<T>(0 - v) : static_cast<T>(v);
+    }
+    // clamps a value to the range of T, as std::istream does
+    template <typename T>
+    static T clamp(long long v)
+    {
+      if (v > static_cast<long long>(std::numeric_limits<T>::max()))
+        return std::numeric_limits<T>::max();
+      if (v < static_cast<long long>(std::numeric_limits<T>::min()))
+        return std::numeric_limits<T>::min();
+      return static_cast<T>(v);
+    }
+    // converts the leading decimal integer of the text, 0 if none, clamped to the range of long long
+    static long long to_signed(const Tokenizer::Lexeme& text)
+    {
+      const char *s = skip(text.begin(), text.end());
+      bool neg = s < text.end() && *s == '-';
+      if (s < text.end() && (*s == '-' || *s == '+'))
+        ++s;
+      unsigned long long max = neg ? 0ULL - static_cast<unsigned long long>(std::numeric_limits<long long>::min()) : std::numeric_limits<long long>::max();
+      unsigned long long v = digits(s, text.end(), max);
+      return neg ? static_cast<long long>(0ULL - v) : static_cast<long long>(v);
+    }
+    // converts the magnitude of the leading decimal integer of the text, 0 if none, clamped to the range of unsigned long long
+    static unsigned long long to_unsigned(const Tokenizer::Lexeme& text, bool& neg)
+    {
+      const char *s = skip(text.begin(), text.end());
+      neg = s < text.end() && *s == '-';
+      if (s < text.end() && (*s == '-' || *s == '+'))
+        ++s;
+      return digits(s, text.end(), std::numeric_limits<unsigned long long>::max());
+    }
+    // converts the text with strtof_l() or strtod_l() in the "C" locale, the text need not be 0-terminated
+    template <typename T>
+    static T to_float(const Tokenizer::Lexeme& text)
+    {
+      char buf[64];
+      if (text.size() >= sizeof(buf))
+        return convert(text.str().c_str(), static_cast<T*>(NULL));
+      memcpy(buf, text.data(), text.size());
+      buf[text.size()] = '\0';
+      return convert(buf, static_cast<T*>(NULL));
+    }
+    static float convert(const char *s, float*)
+    {
+      return strtof_l(s, NULL, c_locale());
+    }
+    static double convert(const char *s, double*)
+    {
+      return strtod_l(s, NULL, c_locale());
+    }
+    // returns the "C" locale, created once and never freed, as values may be extracted at exit
+    static locale_t c_locale()
+    {
+      static locale_t loc = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+      return loc;
+    }
+    static const char *skip(const char *s, const char *e)
+    {
+      while (s < e && (*s == ' ' || (*s >= '\t' && *s <= '\r')))
+        ++s;
+      return s;
+    }
+    static unsigned long long digits(const char *s, const char *e, unsigned long long max)
+    {
+      unsigned long long v = 0;
+      for (; s < e && *s >= '0' && *s <= '9'; ++s)
+      {
+        unsigned d = *s - '0';
+        if (v > (max - d) / 10)
+          return max;
+        v = 10 * v + d;
+      }
+      return v;
+    }
+
+    int                      code_;
+    mutable std::string      copy_;   // copy of the lexeme returned by get_text()
+    mutable bool             copied_; // copy_ is a copy of the lexeme
+    Tokenizer::Lexeme        text_;
+    Tokenizer               *tokens_; // tokenizer to cache values in, or NULL
+    size_t                   pos_;    // position of the token
+    InType                  *in_;
 };
 
 #endif